@@ -637,9 +637,9 @@ class statement : public backend::statement, public boost::static_visitor<>
     };
 
 public:
-    statement(const string_ref& q, MYSQL *conn, session_stat* stat) 
+    statement(const detail::query_template_ptr& tpl, MYSQL *conn, session_stat* stat) 
       : backend::statement(stat)
-      , bind_by_name_helper_(q, detail::question_marker())
+      , bind_by_name_helper_(tpl)
       , stmt_(0)
       , params_count_(0)
     {
@@ -747,6 +747,13 @@ public:
         return mysql_stmt_affected_rows(stmt_);
     }
 
+    virtual size_t memory_usage() const
+    {
+        return sizeof(*this) + bind_by_name_helper_.memory_usage() + PREPARED_HANDLE_MEMORY
+            + params_.capacity() * sizeof(param)
+            + bind_.capacity() * sizeof(MYSQL_BIND);
+    }
+
     ///
     /// Return SQL Query result, MAY throw edba_error if the statement is not a query
     ///
@@ -1031,10 +1038,15 @@ public:
         catch(...) {
         }
     }
+
+    virtual bool ping_impl()
+    {
+        return 0 == mysql_ping(conn_);
+    }
     
     virtual backend::statement_ptr prepare_statement_impl(const string_ref& q)
     {
-        return backend::statement_ptr(new prep::statement(q, conn_, &stat_));
+        return backend::statement_ptr(new prep::statement(query_template(q, detail::question_marker()), conn_, &stat_));
     }
 
     virtual backend::statement_ptr create_statement_impl(const string_ref& q)
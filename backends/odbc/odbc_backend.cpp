@@ -542,13 +542,13 @@ public:
     statement(
         const common_data* cd
       , session_stat* stat
-      , const string_ref& q
+      , const detail::query_template_ptr& tpl
       , bool prepared
       )
       : backend::statement(stat)
       , cd_(cd)
       , prepared_(prepared)
-      , bind_by_name_helper_(q, detail::question_marker())
+      , bind_by_name_helper_(tpl)
       , throw_on_error_(cd->wide_, 0, SQL_HANDLE_STMT)
     {
         // Allocate statement handle
@@ -731,10 +731,10 @@ public:
         statement_ptr st;
 
         if (sequence.empty() && !cd_->last_insert_id_.empty())
-            st.reset(new statement(cd_, stat_.parent_stat(), cd_->last_insert_id_, false));
+            st.reset(new statement(cd_, stat_.parent_stat(), detail::bind_by_name_helper::parse(cd_->last_insert_id_, detail::question_marker()), false));
         else if (!sequence.empty() && !cd_->sequence_last_.empty())
         {
-            st.reset(new statement(cd_, stat_.parent_stat(), cd_->sequence_last_, false));
+            st.reset(new statement(cd_, stat_.parent_stat(), detail::bind_by_name_helper::parse(cd_->sequence_last_, detail::question_marker()), false));
             st->bind(1, sequence);
         }
         else
@@ -768,6 +768,21 @@ public:
         return rows;
     }
 
+    virtual size_t memory_usage() const
+    {
+        size_t res = sizeof(*this) + bind_by_name_helper_.memory_usage() + PREPARED_HANDLE_MEMORY
+            + params_desc_.capacity() * sizeof(param_desc)
+            + params_.capacity() * sizeof(holder_sp);
+
+        BOOST_FOREACH(const holder_sp& p, params_)
+        {
+            if (p)
+                res += sizeof(holder) + p->second.capacity();
+        }
+
+        return res;
+    }
+
     virtual backend::result_ptr query_impl()
     {
         BOOST_AUTO(p, real_exec());
@@ -1073,9 +1088,21 @@ public:
         catch(...){}
     }
 
+    virtual bool ping_impl()
+    {
+        // Driver reports state of connection known from the last operation, no round trip is made
+        SQLUINTEGER dead = SQL_CD_FALSE;
+        SQLRETURN r = SQLGetConnectAttr(dbc_.get(), SQL_ATTR_CONNECTION_DEAD, &dead, 0, 0);
+        return !SQL_SUCCEEDED(r) || SQL_CD_TRUE != dead;
+    }
+
     statement_ptr real_prepare(const string_ref& q, bool prepared)
     {
-        return boost::intrusive_ptr<statement>(new statement(this, &stat_, q, prepared));
+        detail::query_template_ptr tpl = prepared
+            ? query_template(q, detail::question_marker())
+            : detail::bind_by_name_helper::parse(q, detail::question_marker());
+
+        return boost::intrusive_ptr<statement>(new statement(this, &stat_, tpl, prepared));
     }
 
     virtual backend::statement_ptr prepare_statement_impl(const string_ref& q)
@@ -863,6 +863,11 @@ public:
         inside_trans_ = false;
     }
 
+    virtual bool ping_impl()
+    {
+        return OCI_SUCCESS == OCIPing(svcp_.get(), errhp_.get(), OCI_DEFAULT);
+    }
+
     virtual backend::statement_ptr prepare_statement_impl(const string_ref& q)
     {
         return backend::statement_ptr(new statement(q, this, &stat_));
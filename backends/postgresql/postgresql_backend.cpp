@@ -275,9 +275,9 @@ public:
         }
     }
 
-    statement(const common_data* data, const string_ref& src_query, unsigned long long prepared_id, session_stat* stat)
+    statement(const common_data* data, const detail::query_template_ptr& tpl, unsigned long long prepared_id, session_stat* stat)
       : backend::statement(stat)
-      , bind_by_name_helper_(src_query, detail::postgresql_style_marker())
+      , bind_by_name_helper_(tpl)
       , data_(data)
       , res_(0)
       , params_values_(bind_by_name_helper_.bindings_count())
@@ -617,6 +617,21 @@ public:
         return 0;
     }
 
+    virtual size_t memory_usage() const
+    {
+        size_t res = sizeof(*this) + bind_by_name_helper_.memory_usage() + prepared_id_.capacity()
+            + (prepared_id_.empty() ? 0 : PREPARED_HANDLE_MEMORY)
+            + params_values_.capacity() * sizeof(std::string)
+            + params_pvalues_.capacity() * sizeof(char const*)
+            + params_plengths_.capacity() * sizeof(size_t)
+            + params_set_.capacity() * sizeof(param_type);
+
+        BOOST_FOREACH(const std::string& v, params_values_)
+            res += v.capacity();
+
+        return res;
+    }
+
 private:
     void check(int col)
     {
@@ -710,14 +725,20 @@ public:
         inside_transaction_ = false;
     }
 
+    virtual bool ping_impl()
+    {
+        // Status of connection is known by libpq from the last operation, no round trip is made
+        return PQstatus(conn_) == CONNECTION_OK;
+    }
+
     virtual backend::statement_ptr prepare_statement_impl(const string_ref& q)
     {
-        return backend::statement_ptr(new statement(this,q,++prepared_id_, &stat_));
+        return backend::statement_ptr(new statement(this, query_template(q, detail::postgresql_style_marker()), ++prepared_id_, &stat_));
     }
 
     virtual backend::statement_ptr create_statement_impl(const string_ref& q)
     {
-        return backend::statement_ptr(new statement(this,q,0, &stat_));
+        return backend::statement_ptr(new statement(this, detail::bind_by_name_helper::parse(q, detail::postgresql_style_marker()), 0, &stat_));
     }
 
     virtual void exec_batch_impl(const string_ref& q)
@@ -315,6 +315,15 @@ public:
         return sqlite3_changes(conn_);
     }
 
+    virtual size_t memory_usage() const
+    {
+        size_t res = sizeof(*this) + orig_sql_.capacity();
+#ifdef SQLITE_STMTSTATUS_MEMUSED
+        res += sqlite3_stmt_status(st_, SQLITE_STMTSTATUS_MEMUSED, 0);
+#endif
+        return res;
+    }
+
 private:
     void check_bind(int v)
     {
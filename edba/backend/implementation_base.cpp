@@ -5,10 +5,8 @@
 #include <edba/detail/utils.hpp>
 
 #include <boost/algorithm/string/predicate.hpp>
-#include <boost/range/algorithm/equal_range.hpp>
-#include <boost/range/algorithm/sort.hpp>
 #include <boost/typeof/typeof.hpp>
-#include <boost/timer/timer.hpp>
+#include <boost/lexical_cast.hpp>
 
 #include <map>
 #include <list>
@@ -30,16 +28,36 @@ statement::statement(session_stat* sess_stat)
 
 void statement::bind(int col, const bind_types_variant& val)
 {
-    bind_impl(col, val);
+    {
+        statement_stat::measure_bind m(&stat_);
+        bind_impl(col, val);
+    }
     stat_.bind(col, val);
 }
 
 void statement::bind(const string_ref& name, const bind_types_variant& val)
 {
-    bind_impl(name, val);
+    {
+        statement_stat::measure_bind m(&stat_);
+        bind_impl(name, val);
+    }
     stat_.bind(name, val);
 }
 
+void statement::bind(const sql_placeholder& p, const bind_types_variant& val)
+{
+    {
+        statement_stat::measure_bind m(&stat_);
+        bind_impl(p, val);
+    }
+    stat_.bind(p.name(), val);
+}
+
+void statement::bind_impl(const sql_placeholder& p, bind_types_variant const& v)
+{
+    bind_impl(p.name(), v);
+}
+
 void statement::reset_bindings()
 {
     reset_bindings_impl();
@@ -50,7 +68,7 @@ result_ptr statement::run_query()
 {
     result_ptr r;
     {
-        statement_stat::measure_query m(&stat_, &patched_query(), &r);
+        statement_stat::measure_query m(&stat_, &patched_query(), this, &r);
         r = query_impl();
     }
     return r;
@@ -62,23 +80,114 @@ void statement::run_exec()
     exec_impl();
 }
 
+void statement::add_prepare_time(double sec)
+{
+    stat_.add_prepare_time(sec);
+}
+
+void statement::track_latency()
+{
+    stat_.track_latency(patched_query());
+}
+
+size_t statement::memory_usage() const
+{
+    return sizeof(statement) + patched_query().capacity();
+}
+
 //////////////
 //connection
 //////////////
 
-string_ref connection::select_statement(const string_ref& _q)
+namespace {
+
+// Limit for number of memoized conditional queries, memo is dropped when limit is reached
+const size_t max_selected_statements = 1024;
+
+size_t stmt_cache_size(const conn_info& info)
 {
-    string_ref q;
+    int size = info.get("@stmt_cache_size", 64);
+    if (size < 0)
+        throw edba_error("edba::backend::connection: @stmt_cache_size should be non-negative number");
 
-    if(expand_conditionals_)
+    return static_cast<size_t>(size);
+}
+
+size_t stmt_cache_memory(const conn_info& info)
+{
+    int memory = info.get("@stmt_cache_memory", 0);
+    if (memory < 0)
+        throw edba_error("edba::backend::connection: @stmt_cache_memory should be non-negative number");
+
+    return static_cast<size_t>(memory);
+}
+
+unsigned monitor_sample_rate(const conn_info& info)
+{
+    int rate = info.get("@monitor_sample_rate", 1);
+    if (rate < 1)
+        throw edba_error("edba::backend::connection: @monitor_sample_rate should be positive number");
+
+    return static_cast<unsigned>(rate);
+}
+
+double monitor_slow_threshold(const conn_info& info)
+{
+    string_ref ms = info.get("@monitor_slow_ms", "0");
+
+    double res = -1.0;
+    try
     {
-        int major;
-        int minor;
-        version(major, minor);
-        q = ::edba::select_statement(_q, engine(), major, minor);
+        res = boost::lexical_cast<double>(ms);
     }
-    else
-        q = _q;
+    catch(const boost::bad_lexical_cast&)
+    {
+    }
+
+    if (!(res >= 0.0))
+        throw edba_error("edba::backend::connection: @monitor_slow_ms should be non-negative number");
+
+    return res / 1000.0;
+}
+
+bool monitor_cpu_time(const conn_info& info)
+{
+    const std::locale& loc = std::locale::classic();
+    string_ref cpu_time = info.get("@monitor_cpu_time", "off");
+    if (boost::algorithm::iequals(cpu_time, "on", loc))
+        return true;
+    if (boost::algorithm::iequals(cpu_time, "off", loc))
+        return false;
+
+    throw edba_error("edba::backend::connection: @monitor_cpu_time should be either 'on' or 'off'");
+}
+
+}
+
+string_ref connection::select_statement(const string_ref& _q)
+{
+    if(!expand_conditionals_)
+        return _q;
+
+    // Plain queries don`t need any selection, avoid hashing and backend calls for them
+    string_ref trimmed = trim(_q);
+    if (trimmed.empty() || '~' != trimmed.front())
+        return trimmed;
+
+    selected_statements_map::const_iterator found = selected_.find(_q, string_ref_hash(), string_ref_equal());
+    if (selected_.end() != found)
+        return string_ref(_q.begin() + found->second.first, found->second.second);
+
+    int major;
+    int minor;
+    version(major, minor);
+    string_ref q = ::edba::select_statement(_q, engine(), major, minor);
+
+    if (selected_.size() >= max_selected_statements)
+        selected_.clear();
+
+    size_t offset = q.empty() ? 0 : static_cast<size_t>(q.begin() - _q.begin());
+    selected_.insert(std::make_pair(to_string(_q), std::make_pair(offset, q.size())));
 
     return q;
 }
@@ -90,21 +199,49 @@ statement_ptr connection::prepare_statement(const string_ref& _q)
     if (q.empty())
         return statement_ptr();
 
-    BOOST_AUTO(found, (boost::equal_range(cache_, q, string_ref_less())));
-    if (boost::empty(found))
+    return prepare_statement(q, string_ref_hash()(q));
+}
+
+statement_ptr connection::prepare_statement(const sql_literal& q)
+{
+    // Literal was trimmed at compile time, but with disabled conditionals expansion query is used as is
+    if (q.conditional() || (!expand_conditionals_ && !q.is_trimmed()))
+        return prepare_statement(q.str());
+
+    if (q.trimmed().empty())
+        return statement_ptr();
+
+    return prepare_statement(q.trimmed(), q.hash());
+}
+
+statement_ptr connection::prepare_statement(const string_ref& q, std::size_t hash)
+{
+    statement_ptr st = cache_.fetch(q, hash);
+    if (!st)
     {
-        statement_ptr st = prepare_statement_impl(q);
-        cache_.resize(cache_.size() + 1);
-        cache_.back().first.assign(q.begin(), q.end());
-        cache_.back().second = st;
-        boost::sort(cache_, string_ref_less());
-        return st;
+        stat_clock::time_point start = stat_clock::now();
+        st = prepare_statement_impl(q);
+        double sec = stat_clock::seconds_since(start);
+        cache_.add_prepare_time(sec);
+
+        if (statement* s = dynamic_cast<statement*>(st.get()))
+        {
+            // Prepare time is reported to monitor with the first execution of statement
+            if (stat_.user_monitor())
+                s->add_prepare_time(sec);
+
+            // Histogram is looked up once per cached statement, so one-off queries neither lock
+            // shared registry nor fill it with their texts
+            if (stat_.latencies() && cache_.capacity())
+                s->track_latency();
+        }
+
+        cache_.put(q, st);
     }
     else
-    {
-        found.first->second->reset_bindings();
-        return found.first->second;
-    }
+        st->reset_bindings();
+
+    return st;
 }
 
 void connection::before_destroy()
@@ -141,6 +278,29 @@ boost::any& connection::get_specific()
     return specific_data_;
 }
 
+void connection::set_query_templates(const boost::shared_ptr<query_template_cache>& templates)
+{
+    templates_ = templates;
+}
+
+void connection::set_latency_registry(const boost::shared_ptr<latency_registry>& latencies)
+{
+    stat_.set_latencies(latencies);
+}
+
+std::vector<query_latency> connection::query_latencies() const
+{
+    return stat_.latencies() ? stat_.latencies()->report() : std::vector<query_latency>();
+}
+
+detail::query_template_ptr connection::query_template(
+    const string_ref& q
+  , const detail::bind_by_name_helper::print_func_type& print_func
+  )
+{
+    return templates_ ? templates_->get(q, print_func) : detail::bind_by_name_helper::parse(q, print_func);
+}
+
 void connection::begin()
 {
     begin_impl();
@@ -167,11 +327,33 @@ void connection::rollback()
     stat_.transaction_reverted();
 }
 
+bool connection::ping_impl()
+{
+    return true;
+}
+
+bool connection::ping()
+{
+    try
+    {
+        return ping_impl();
+    }
+    catch(...)
+    {
+        return false;
+    }
+}
+
 double connection::total_execution_time() const
 {
     return stat_.total_execution_time();
 }
 
+statement_cache_stat connection::cache_stat() const
+{
+    return cache_.stat();
+}
+
 const conn_info& connection::connection_info() const
 {
     return info_;
@@ -179,8 +361,12 @@ const conn_info& connection::connection_info() const
 
 connection::connection(conn_info const &info, session_monitor* sm)
   : info_(info)
-  , stat_(sm)
+  , stat_(sm, create_latency_registry(info), monitor_sample_rate(info), monitor_slow_threshold(info), monitor_cpu_time(info))
+  , cache_(stmt_cache_size(info), stmt_cache_memory(info))
 {
+    // Same identifier as session_pool reports for pooled connection
+    stat_.set_connection_id(reinterpret_cast<std::size_t>(static_cast<connection_iface*>(this)));
+
     const std::locale& loc = std::locale::classic();
     string_ref exp_cond = info.get("@expand_conditionals", "on");
     if(boost::algorithm::iequals(exp_cond, "on", loc))
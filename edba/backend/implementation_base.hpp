@@ -3,14 +3,22 @@
 
 #include <edba/backend/interfaces.hpp>
 #include <edba/backend/statistics.hpp>
+#include <edba/backend/statement_cache.hpp>
+#include <edba/backend/query_template_cache.hpp>
 #include <edba/conn_info.hpp>
 
+#include <boost/unordered_map.hpp>
+
 #include <vector>
 #include <utility>
 #include <string>
 
 namespace edba { namespace backend {
 
+/// Estimate of memory in bytes held by prepared statement outside of statement object: driver handle
+/// and statement with its plan kept by server for connection. Backends add it to statement memory_usage()
+const size_t PREPARED_HANDLE_MEMORY = 4096;
+
 class result : public result_iface 
 {
 };
@@ -32,6 +40,12 @@ protected:
     virtual void bind_impl(int col, bind_types_variant const& v) = 0;
     virtual void bind_impl(const string_ref& name, bind_types_variant const& v) = 0; 
 
+    ///
+    /// Bind variant value to placeholder resolved from sql_literal. Default implementation binds it by name,
+    /// backends that number placeholders by their occurrences bind it to resolved columns.
+    ///
+    virtual void bind_impl(const sql_placeholder& p, bind_types_variant const& v);
+
     ///
     /// Reset all bindings
     ///
@@ -62,6 +76,13 @@ public:
     ///
     void bind(const string_ref& name, const bind_types_variant& val);
 
+    ///
+    /// Bind value to placeholder resolved from sql_literal.
+    /// 
+    /// Dispatch call to suitable implementation
+    ///
+    void bind(const sql_placeholder& p, const bind_types_variant& val);
+
     ///
     /// Reset all bindings to initial state
     ///
@@ -77,6 +98,22 @@ public:
     ///
     void run_exec();
 
+    ///
+    /// Default estimation of memory held by statement, count only patched query. 
+    /// Backends should override it to account parameter buffers and handles.
+    ///
+    size_t memory_usage() const;
+
+    ///
+    /// Account time spent on preparing statement, it is reported to session_monitor with the next execution
+    ///
+    void add_prepare_time(double sec);
+
+    ///
+    /// Record executions of statement in latency histogram of session, called when statement is put into cache
+    ///
+    void track_latency();
+
 protected:    
     statement_stat stat_; 
 };
@@ -118,6 +155,12 @@ protected:
     ///
     virtual void rollback_impl() = 0;
 
+    ///
+    /// Check that connection is alive without round trip to server if backend can do it.
+    /// Backends that can`t check connection, like sqlite3, use this implementation that returns true.
+    ///
+    virtual bool ping_impl();
+
 public:
     connection(conn_info const &info, session_monitor* sm);
 
@@ -125,9 +168,19 @@ public:
     /// Try get already compiled statement from the cache. If failed then use prepare_statement_impl 
     /// to create prepared statement. \a q. May throw if preparation had failed.
     /// Should never return null value.
+    ///
+    /// Cache size is limited by \@stmt_cache_size connection option (64 by default, 0 disables cache)
+    /// and by \@stmt_cache_memory option (approximate memory in bytes held by cached statements, 0 by default, that means no limit).
+    /// Least recently used statement is evicted from cache when limit is reached.
     /// 
     statement_ptr prepare_statement(const string_ref& q);
 
+    ///
+    /// Same as prepare_statement(q.str()). For queries without engine conditionals trimming and hashing
+    /// of query text are skipped, they were done at compile time.
+    ///
+    statement_ptr prepare_statement(const sql_literal& q);
+
     ///
     /// Create a (unprepared) statement \a q. May throw if had failed.
     /// Should never return null value.
@@ -149,25 +202,54 @@ public:
     ///
     boost::any& get_specific();
 
+    ///
+    /// Use \a templates cache of parsed queries for new prepared statements
+    ///
+    void set_query_templates(const boost::shared_ptr<query_template_cache>& templates);
+
+    ///
+    /// Record execution times to \a latencies registry. By default connection has own registry limited
+    /// by \@stmt_latency_limit option, that is number of distinct statements (1024 by default, 0 disables recording).
+    ///
+    void set_latency_registry(const boost::shared_ptr<latency_registry>& latencies);
+
     // API 
 
     void begin();
     void commit();
     void rollback();
+    bool ping();
 
     double total_execution_time() const;
+    statement_cache_stat cache_stat() const;
+    std::vector<query_latency> query_latencies() const;
     const conn_info& connection_info() const;
 
 protected:
-    typedef std::vector< std::pair<std::string, statement_ptr > > stmt_map;
+    // Map from original query text to [offset, offset + size) range of selected statement in it
+    typedef boost::unordered_map<
+        std::string
+      , std::pair<size_t, size_t>
+      , string_ref_hash
+      , string_ref_equal
+      > selected_statements_map;
 
     void before_destroy();
     string_ref select_statement(const string_ref& _q);
+    statement_ptr prepare_statement(const string_ref& q, std::size_t hash);
+
+    ///
+    /// Return parsed query \a q with markers printed by \a print_func. Take it from shared cache
+    /// if connection has one, otherwise parse query. Backends should use it in prepare_statement_impl.
+    ///
+    detail::query_template_ptr query_template(const string_ref& q, const detail::bind_by_name_helper::print_func_type& print_func);
 
     conn_info info_;
     session_stat stat_;
-    stmt_map cache_;                              // Statement cache
+    statement_cache cache_;                       // Statement cache
+    selected_statements_map selected_;            // Memoized results of select_statement for conditional queries
     boost::any specific_data_;                    // Connection specific data
+    boost::shared_ptr<query_template_cache> templates_; // Parsed queries, may be shared between connections
     unsigned expand_conditionals_ : 1;            // If true then process query as list of backend specific queries
     unsigned reserved_ : 30;
 };
@@ -3,13 +3,21 @@
 
 #include <edba/types.hpp>
 #include <edba/string_ref.hpp>
+#include <edba/statement_cache_stat.hpp>
+#include <edba/latency_histogram.hpp>
+#include <edba/sql_literal.hpp>
 
 #include <boost/any.hpp>
+#include <boost/shared_ptr.hpp>
 
 #include <string>
+#include <vector>
 
 namespace edba { namespace backend {
 
+class query_template_cache;
+class latency_registry;
+
 struct result_iface : ref_cnt
 {
 public:
@@ -89,6 +97,13 @@ struct statement_iface : ref_cnt
     ///
     virtual void bind(const string_ref& name, const bind_types_variant& val) = 0;
 
+    ///
+    /// Bind value to placeholder resolved from sql_literal.
+    ///
+    /// Dispatch call to suitable implementation
+    ///
+    virtual void bind(const sql_placeholder& p, const bind_types_variant& val) = 0;
+
     ///
     /// Reset all bindings to initial state
     ///
@@ -126,6 +141,12 @@ struct statement_iface : ref_cnt
     /// Should be called after exec(), otherwise behavior is undefined.
     ///
     virtual unsigned long long affected() = 0;
+
+    ///
+    /// Return approximate memory in bytes held by statement: query text, parameter buffers
+    /// and memory of backend handle, reported by backend library or estimated.
+    ///
+    virtual size_t memory_usage() const = 0;
 };
 
 struct connection_iface : public ref_cnt
@@ -139,6 +160,11 @@ struct connection_iface : public ref_cnt
     ///
     virtual statement_ptr prepare_statement(const string_ref& q) = 0;
 
+    ///
+    /// Same as prepare_statement(q.str()), but use hash and trimmed text evaluated at compile time.
+    ///
+    virtual statement_ptr prepare_statement(const sql_literal& q) = 0;
+
     ///
     /// Create a (unprepared) statement \a q. May throw if had failed.
     /// Should never return null value.
@@ -160,6 +186,18 @@ struct connection_iface : public ref_cnt
     ///
     virtual boost::any& get_specific() = 0;
 
+    ///
+    /// Use \a templates cache of parsed queries for new prepared statements. Cache may be shared between
+    /// connections of the same backend.
+    ///
+    virtual void set_query_templates(const boost::shared_ptr<query_template_cache>& templates) = 0;
+
+    ///
+    /// Record execution times of statements to \a latencies registry, registry may be shared between
+    /// connections. Null pointer disables recording for statements created after the call.
+    ///
+    virtual void set_latency_registry(const boost::shared_ptr<latency_registry>& latencies) = 0;
+
     // API
 
     ///
@@ -177,6 +215,11 @@ struct connection_iface : public ref_cnt
     ///
     virtual void rollback() = 0;
 
+    ///
+    /// Cheaply check that connection to server is alive, return false if it is broken. MUST never throw.
+    ///
+    virtual bool ping() = 0;
+
     ///
     /// Escape a string for inclusion in SQL query. May throw not_supported_by_backend() if not supported by backend.
     ///
@@ -203,6 +246,14 @@ struct connection_iface : public ref_cnt
     ///
     virtual double total_execution_time() const = 0;
     ///
+    /// Return counters of prepared statements cache
+    ///
+    virtual statement_cache_stat cache_stat() const = 0;
+    ///
+    /// Return execution time percentiles of statements recorded to connection latency registry
+    ///
+    virtual std::vector<query_latency> query_latencies() const = 0;
+    ///
     /// Return conn_info object provided for connection during construction
     ///
     virtual const conn_info& connection_info() const = 0;
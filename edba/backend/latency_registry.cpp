@@ -0,0 +1,75 @@
+#include <edba/backend/latency_registry.hpp>
+
+#include <edba/errors.hpp>
+
+#include <boost/make_shared.hpp>
+
+namespace edba { namespace backend {
+
+latency_registry::latency_registry(size_t max_size)
+  : max_size_(max_size)
+{
+}
+
+boost::shared_ptr<latency_histogram> latency_registry::get(const string_ref& q)
+{
+    boost::mutex::scoped_lock g(guard_);
+
+    histograms_map::const_iterator found = histograms_.find(q, string_ref_hash(), string_ref_equal());
+    if (histograms_.end() != found)
+        return found->second;
+
+    // Histograms are never dropped, statements keep pointers to them
+    if (histograms_.size() >= max_size_)
+        return boost::shared_ptr<latency_histogram>();
+
+    boost::shared_ptr<latency_histogram> h(new latency_histogram);
+    histograms_.insert(std::make_pair(to_string(q), h));
+    return h;
+}
+
+std::vector<query_latency> latency_registry::report() const
+{
+    std::vector<query_latency> res;
+
+    boost::mutex::scoped_lock g(guard_);
+    res.reserve(histograms_.size());
+
+    for (histograms_map::const_iterator i = histograms_.begin(); i != histograms_.end(); ++i)
+    {
+        res.resize(res.size() + 1);
+        res.back().query = i->first;
+        i->second->fill(res.back());
+    }
+
+    return res;
+}
+
+void latency_registry::snapshot(std::vector<entry>& res) const
+{
+    res.clear();
+
+    boost::mutex::scoped_lock g(guard_);
+    res.reserve(histograms_.size());
+
+    // Nodes of unordered_map are not relocated on rehash and histograms are never dropped, so keys stay valid
+    for (histograms_map::const_iterator i = histograms_.begin(); i != histograms_.end(); ++i)
+        res.push_back(entry(&i->first, i->second));
+}
+
+size_t latency_registry::size() const
+{
+    boost::mutex::scoped_lock g(guard_);
+    return histograms_.size();
+}
+
+boost::shared_ptr<latency_registry> create_latency_registry(const conn_info& info)
+{
+    int limit = info.get("@stmt_latency_limit", 1024);
+    if (limit < 0)
+        throw edba_error("edba::backend::connection: @stmt_latency_limit should be non-negative number");
+
+    return limit ? boost::make_shared<latency_registry>(static_cast<size_t>(limit)) : boost::shared_ptr<latency_registry>();
+}
+
+}}
@@ -0,0 +1,76 @@
+#ifndef EDBA_BACKEND_LATENCY_REGISTRY_HPP
+#define EDBA_BACKEND_LATENCY_REGISTRY_HPP
+
+#include <edba/latency_histogram.hpp>
+#include <edba/string_ref.hpp>
+#include <edba/conn_info.hpp>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <vector>
+
+namespace edba { namespace backend {
+
+///
+/// \brief Thread-safe set of latency histograms, one per distinct statement text
+///
+/// session_pool creates one registry for all its connections, so histograms aggregate executions in all sessions.
+/// Statement looks its histogram up only once, after that executions are recorded without locks.
+///
+class EDBA_API latency_registry : boost::noncopyable
+{
+public:
+    /// Statement text and its histogram. Text is owned by registry, it is valid while registry exists
+    typedef std::pair<const std::string*, boost::shared_ptr<const latency_histogram> > entry;
+
+    ///
+    /// Create registry that tracks at most \a max_size distinct statements, zero disables tracking
+    ///
+    explicit latency_registry(size_t max_size = 1024);
+
+    ///
+    /// Return histogram for statement \a q, create it if there is no one yet.
+    /// Return null pointer if limit of distinct statements is reached.
+    ///
+    boost::shared_ptr<latency_histogram> get(const string_ref& q);
+
+    ///
+    /// Return percentiles of all tracked statements
+    ///
+    std::vector<query_latency> report() const;
+
+    ///
+    /// Replace content of \a res with all tracked statements. Histograms are read after the call
+    /// without registry lock, so \a res may be reused to avoid allocations.
+    ///
+    void snapshot(std::vector<entry>& res) const;
+
+    ///
+    /// Return number of tracked statements
+    ///
+    size_t size() const;
+
+private:
+    typedef boost::unordered_map<
+        std::string
+      , boost::shared_ptr<latency_histogram>
+      , string_ref_hash
+      , string_ref_equal
+      > histograms_map;
+
+    size_t max_size_;
+    histograms_map histograms_;
+    mutable boost::mutex guard_;
+};
+
+///
+/// Create registry limited by \@stmt_latency_limit option of \a info, return null pointer if option is 0
+///
+EDBA_API boost::shared_ptr<latency_registry> create_latency_registry(const conn_info& info);
+
+}} // namespace edba, backend
+
+#endif // EDBA_BACKEND_LATENCY_REGISTRY_HPP
@@ -0,0 +1,39 @@
+#include <edba/backend/query_template_cache.hpp>
+
+namespace edba { namespace backend {
+
+query_template_cache::query_template_cache(size_t max_size)
+  : max_size_(max_size)
+{
+}
+
+detail::query_template_ptr query_template_cache::get(
+    const string_ref& q
+  , const detail::bind_by_name_helper::print_func_type& print_func
+  )
+{
+    {
+        boost::mutex::scoped_lock g(guard_);
+        templates_map::const_iterator found = templates_.find(q, string_ref_hash(), string_ref_equal());
+        if (templates_.end() != found)
+            return found->second;
+    }
+
+    detail::query_template_ptr tpl = detail::bind_by_name_helper::parse(q, print_func);
+
+    boost::mutex::scoped_lock g(guard_);
+
+    if (templates_.size() >= max_size_)
+        templates_.clear();
+
+    // If other thread has already parsed the same query then use its template
+    return templates_.insert(std::make_pair(to_string(q), tpl)).first->second;
+}
+
+size_t query_template_cache::size() const
+{
+    boost::mutex::scoped_lock g(guard_);
+    return templates_.size();
+}
+
+}}
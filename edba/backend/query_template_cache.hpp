@@ -0,0 +1,54 @@
+#ifndef EDBA_BACKEND_QUERY_TEMPLATE_CACHE_HPP
+#define EDBA_BACKEND_QUERY_TEMPLATE_CACHE_HPP
+
+#include <edba/detail/bind_by_name_helper.hpp>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/noncopyable.hpp>
+
+namespace edba { namespace backend {
+
+///
+/// \brief Thread-safe cache of parsed queries shared between connections
+///
+/// session_pool creates one cache for all its connections, so each query is parsed by bind_by_name_helper
+/// only once for the whole pool. All connections that share cache must use the same style of bind markers,
+/// which is always true for connections of the same backend.
+///
+class EDBA_API query_template_cache : boost::noncopyable
+{
+public:
+    ///
+    /// Create cache that holds at most \a max_size templates. When limit is reached cache is cleared,
+    /// templates that are already in use by statements stay valid.
+    ///
+    explicit query_template_cache(size_t max_size = 4096);
+
+    ///
+    /// Return parsed query \a q, parse it with \a print_func if it is not in cache yet.
+    /// Parsing is done outside of cache lock.
+    ///
+    detail::query_template_ptr get(const string_ref& q, const detail::bind_by_name_helper::print_func_type& print_func);
+
+    ///
+    /// Return number of templates currently in cache
+    ///
+    size_t size() const;
+
+private:
+    typedef boost::unordered_map<
+        std::string
+      , detail::query_template_ptr
+      , string_ref_hash
+      , string_ref_equal
+      > templates_map;
+
+    size_t max_size_;
+    templates_map templates_;
+    mutable boost::mutex guard_;
+};
+
+}} // namespace edba, backend
+
+#endif // EDBA_BACKEND_QUERY_TEMPLATE_CACHE_HPP
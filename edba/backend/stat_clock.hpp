@@ -0,0 +1,90 @@
+#ifndef EDBA_BACKEND_STAT_CLOCK_HPP
+#define EDBA_BACKEND_STAT_CLOCK_HPP
+
+#include <boost/chrono/chrono.hpp>
+#include <boost/cstdint.hpp>
+
+#if defined(EDBA_STAT_CLOCK_TSC)
+#  if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#    include <intrin.h>
+#  elif defined(__i386__) || defined(__x86_64__)
+#    include <x86intrin.h>
+#  else
+#    error "EDBA_STAT_CLOCK_TSC is supported only on x86 platforms"
+#  endif
+#endif
+
+namespace edba { namespace backend {
+
+///
+/// \brief Clock used to measure time spent in database calls for statistics and session_monitor
+///
+/// Only wall time is measured. By default it is steady_clock, on Linux it is served by vDSO without system call.
+/// When EDBA_STAT_CLOCK_TSC is defined (see cmake option with the same name) CPU time stamp counter is read instead.
+/// It is cheaper but gives correct results only on CPUs with invariant TSC. Frequency of counter is calibrated
+/// against steady_clock on first use.
+///
+struct stat_clock
+{
+    /// Clock ticks, nanoseconds for steady_clock
+    typedef boost::uint64_t time_point;
+
+    static time_point now()
+    {
+#if defined(EDBA_STAT_CLOCK_TSC)
+        return __rdtsc();
+#else
+        return boost::chrono::duration_cast<boost::chrono::nanoseconds>(
+            boost::chrono::steady_clock::now().time_since_epoch()
+            ).count();
+#endif
+    }
+
+    /// Return seconds elapsed between \a start and \a end
+    static double seconds(time_point start, time_point end)
+    {
+#if defined(EDBA_STAT_CLOCK_TSC)
+        return double(end - start) / ticks_per_second();
+#else
+        return double(end - start) * 1e-9;
+#endif
+    }
+
+    /// Return seconds elapsed since \a start
+    static double seconds_since(time_point start)
+    {
+        return seconds(start, now());
+    }
+
+#if defined(EDBA_STAT_CLOCK_TSC)
+private:
+    static double ticks_per_second()
+    {
+        static const double ticks = calibrate();
+        return ticks;
+    }
+
+    // Count TSC ticks during few milliseconds of steady_clock
+    static double calibrate()
+    {
+        typedef boost::chrono::steady_clock clock;
+
+        clock::time_point start = clock::now();
+        boost::uint64_t tsc_start = __rdtsc();
+
+        clock::duration elapsed;
+        do
+        {
+            elapsed = clock::now() - start;
+        }
+        while (elapsed < boost::chrono::milliseconds(5));
+
+        boost::uint64_t tsc_end = __rdtsc();
+        return double(tsc_end - tsc_start) / boost::chrono::duration<double>(elapsed).count();
+    }
+#endif
+};
+
+}} // namespace edba, backend
+
+#endif // EDBA_BACKEND_STAT_CLOCK_HPP
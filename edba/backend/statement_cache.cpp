@@ -0,0 +1,119 @@
+#include <edba/backend/statement_cache.hpp>
+#include <edba/backend/interfaces.hpp>
+
+namespace edba { namespace backend {
+
+statement_cache::statement_cache(size_t capacity, size_t max_memory)
+  : capacity_(capacity)
+  , max_memory_(max_memory)
+  , memory_(0)
+{
+}
+
+statement_ptr statement_cache::fetch(const string_ref& q)
+{
+    return fetch(q, string_ref_hash()(q));
+}
+
+statement_ptr statement_cache::fetch(const string_ref& q, std::size_t hash)
+{
+    index_type::iterator found = index_.find(q, known_hash(hash), string_ref_equal());
+    if (index_.end() == found)
+    {
+        ++stat_.misses;
+        return statement_ptr();
+    }
+
+    ++stat_.hits;
+
+    // Move entry to the front of lru list, iterators stay valid
+    lru_.splice(lru_.begin(), lru_, found->second);
+
+    // Buffers of statement may have grown since it was measured
+    statement_ptr st = found->second->stmt;
+    measure(*found->second);
+    shrink();
+    return st;
+}
+
+void statement_cache::put(const string_ref& q, const statement_ptr& st)
+{
+    if (!capacity_)
+        return;
+
+    index_type::iterator found = index_.find(q);
+    if (index_.end() != found)
+    {
+        found->second->stmt = st;
+        measure(*found->second);
+        lru_.splice(lru_.begin(), lru_, found->second);
+    }
+    else
+    {
+        lru_.push_front(entry());
+        lru_.front().query.assign(q.begin(), q.end());
+        lru_.front().stmt = st;
+        measure(lru_.front());
+        index_.insert(std::make_pair(string_ref(lru_.front().query), lru_.begin()));
+    }
+
+    shrink();
+}
+
+void statement_cache::clear()
+{
+    index_.clear();
+    lru_.clear();
+    memory_ = 0;
+}
+
+size_t statement_cache::size() const
+{
+    return index_.size();
+}
+
+size_t statement_cache::capacity() const
+{
+    return capacity_;
+}
+
+size_t statement_cache::memory() const
+{
+    return memory_;
+}
+
+void statement_cache::add_prepare_time(double sec)
+{
+    stat_.prepare_time += sec;
+}
+
+statement_cache_stat statement_cache::stat() const
+{
+    statement_cache_stat res = stat_;
+    res.entries = static_cast<long long>(size());
+    res.memory = static_cast<long long>(memory());
+    return res;
+}
+
+void statement_cache::measure(entry& e)
+{
+    memory_ -= e.memory;
+    e.memory = e.query.capacity() + e.stmt->memory_usage();
+    memory_ += e.memory;
+}
+
+void statement_cache::shrink()
+{
+    while (lru_.size() > capacity_ || (max_memory_ && memory_ > max_memory_ && lru_.size() > 1))
+        evict();
+}
+
+void statement_cache::evict()
+{
+    ++stat_.evictions;
+    memory_ -= lru_.back().memory;
+    index_.erase(string_ref(lru_.back().query));
+    lru_.pop_back();
+}
+
+}}
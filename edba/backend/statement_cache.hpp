@@ -0,0 +1,116 @@
+#ifndef EDBA_BACKEND_STATEMENT_CACHE_HPP
+#define EDBA_BACKEND_STATEMENT_CACHE_HPP
+
+#include <edba/types.hpp>
+#include <edba/statement_cache_stat.hpp>
+
+#include <boost/unordered_map.hpp>
+
+#include <list>
+#include <string>
+
+namespace edba { namespace backend {
+
+///
+/// \brief Size bounded LRU cache of prepared statements
+///
+/// Statements are looked up by the text of query using hash table, so both hit and miss are O(1).
+/// When number of cached statements exceeds capacity or approximate memory held by them exceeds memory limit
+/// the least recently used statement is dropped from cache. The most recently added statement is always kept.
+/// Memory of statement is measured when it is cached and again on each hit, so parameter buffers grown by
+/// previous executions are accounted.
+/// Backend statement is finalized (deallocated on server) when the last reference to it is released.
+///
+class EDBA_API statement_cache
+{
+public:
+    ///
+    /// Create cache that holds at most \a capacity statements. Zero capacity disables caching.
+    /// Statements are also evicted when they hold more then \a max_memory bytes, zero means no memory limit.
+    ///
+    explicit statement_cache(size_t capacity, size_t max_memory = 0);
+
+    ///
+    /// Return cached statement for query \a q and mark it as most recently used.
+    /// Return null pointer if there is no such statement in cache.
+    /// Count cache hit or miss. Memory of found statement is measured again, other statements may be evicted.
+    ///
+    statement_ptr fetch(const string_ref& q);
+
+    ///
+    /// Same as fetch(q), but use already evaluated \a hash of query, it must be equal to string_ref_hash()(q).
+    ///
+    statement_ptr fetch(const string_ref& q, std::size_t hash);
+
+    ///
+    /// Put statement \a st for query \a q into cache, evict least recently used statement if capacity is exceeded.
+    ///
+    void put(const string_ref& q, const statement_ptr& st);
+
+    ///
+    /// Drop all statements from cache
+    ///
+    void clear();
+
+    ///
+    /// Return number of statements currently in cache
+    ///
+    size_t size() const;
+
+    ///
+    /// Return maximum number of statements that can be held in cache
+    ///
+    size_t capacity() const;
+
+    ///
+    /// Return approximate memory in bytes held by cached statements
+    ///
+    size_t memory() const;
+
+    ///
+    /// Account time in seconds spent on preparing statement after cache miss
+    ///
+    void add_prepare_time(double sec);
+
+    ///
+    /// Return cache counters
+    ///
+    statement_cache_stat stat() const;
+
+private:
+    struct entry
+    {
+        entry() : memory(0) {}
+
+        std::string query;
+        statement_ptr stmt;
+        size_t memory;                            // Memory held by query text and statement when it was cached or fetched last time
+    };
+    typedef std::list<entry> lru_list;
+
+    // Keys refer to query text stored in lru_list nodes, list nodes are never relocated
+    typedef boost::unordered_map<string_ref, lru_list::iterator, string_ref_hash, string_ref_equal> index_type;
+
+    // Hash functor that return precomputed value
+    struct known_hash
+    {
+        known_hash(std::size_t hash) : hash_(hash) {}
+        std::size_t operator()(const string_ref&) const { return hash_; }
+        std::size_t hash_;
+    };
+
+    void measure(entry& e);
+    void shrink();
+    void evict();
+
+    size_t capacity_;
+    size_t max_memory_;
+    size_t memory_;
+    lru_list lru_;                                // Most recently used statements are in front
+    index_type index_;                            // Query text to lru_ node map
+    statement_cache_stat stat_;                   // Counters, entries and memory members are maintained by size() and memory()
+};
+
+}} // namespace edba, backend
+
+#endif // EDBA_BACKEND_STATEMENT_CACHE_HPP
@@ -1,7 +1,9 @@
 #include <edba/backend/statistics.hpp>
 #include <edba/backend/interfaces.hpp>
 
-#include <boost/chrono/chrono.hpp>
+#include <boost/chrono/thread_clock.hpp>
+
+#include <sstream>
 
 namespace edba { namespace backend {
 
@@ -36,61 +38,293 @@ private:
     std::ostream& os_;
 };
 
+// Forward calls to backend result, count fetched rows and measure fetch time.
+// Reports execution phases of query to session_monitor on destruction
+class measured_result : public result_iface
+{
+public:
+    measured_result(
+        const result_ptr& res
+      , statement_iface* st
+      , statement_stat* stat
+      , const std::string* query
+      , const execution_phases& phases
+      , double cpu_start
+      )
+      : res_(res)
+      , st_(st)
+      , stat_(stat)
+      , query_(query)
+      , phases_(phases)
+      , cpu_start_(cpu_start)
+      , executed_(stat_clock::now())
+      , first_row_fetched_(false)
+    {
+    }
+
+    ~measured_result()
+    {
+        phases_.fetch_time = stat_clock::seconds_since(executed_);
+        if (phases_.cpu_time >= 0)
+            phases_.cpu_time = statement_stat::thread_cpu_time() - cpu_start_;
+
+        // Backend result should be released before statement is used once again
+        res_.reset();
+
+        try
+        {
+            if (session_monitor* sm = stat_->parent_stat()->user_monitor())
+                sm->query_executed(query_->c_str(), stat_->bindings(), true, phases_);
+        }
+        catch(...)
+        {
+            // Nothing can be done, it is destructor
+        }
+    }
+
+    virtual next_row has_next()
+    {
+        return res_->has_next();
+    }
+
+    virtual bool next()
+    {
+        bool res = res_->next();
+
+        if (!first_row_fetched_)
+        {
+            phases_.first_row_time = stat_clock::seconds_since(executed_);
+            first_row_fetched_ = true;
+        }
+
+        if (res)
+            ++phases_.rows;
+
+        return res;
+    }
+
+    virtual bool fetch(int col, const fetch_types_variant& v)
+    {
+        return res_->fetch(col, v);
+    }
+
+    virtual bool is_null(int col)
+    {
+        return res_->is_null(col);
+    }
+
+    virtual int cols()
+    {
+        return res_->cols();
+    }
+
+    virtual boost::uint64_t rows()
+    {
+        return res_->rows();
+    }
+
+    virtual int name_to_column(const string_ref& n)
+    {
+        return res_->name_to_column(n);
+    }
+
+    virtual std::string column_to_name(int col)
+    {
+        return res_->column_to_name(col);
+    }
+
+private:
+    result_ptr res_;
+    statement_ptr st_;                            // Keep statement alive, stat_ and query_ belong to it
+    statement_stat* stat_;
+    const std::string* query_;
+    execution_phases phases_;
+    double cpu_start_;
+    stat_clock::time_point executed_;
+    bool first_row_fetched_;
+};
+
 }
 
-void statement_stat::bind(const string_ref& name, const bind_types_variant& val)
+void captured_bindings::add(int col, const string_ref& name, const bind_types_variant& val)
 {
-    if (session_stat_->user_monitor())
+    entries_.resize(entries_.size() + 1);
+    entry& e = entries_.back();
+
+    e.col_ = col;
+    e.name_begin_ = text_.size();
+    text_.append(name.begin(), name.end());
+    e.name_end_ = text_.size();
+    e.value_ = val;
+    e.value_begin_ = e.value_end_ = text_.size();
+
+    if (const string_ref* s = boost::get<string_ref>(&val))
     {
-        bindings_ << "['" << name << "', ";
-        dump_to_ostream vis(bindings_);
-        val.apply_visitor(vis);
-        bindings_ << ']';
+        text_.append(s->begin(), s->end());
+        e.value_end_ = text_.size();
     }
 }
 
+void captured_bindings::clear()
+{
+    entries_.clear();
+    text_.clear();
+}
+
+size_t captured_bindings::size() const
+{
+    return entries_.size();
+}
+
+std::string captured_bindings::str() const
+{
+    std::ostringstream os;
+    dump_to_ostream vis(os);
+
+    for (std::vector<entry>::const_iterator e = entries_.begin(); e != entries_.end(); ++e)
+    {
+        if (e->col_)
+            os << '[' << e->col_ << ", ";
+        else
+            os << "['" << string_ref(text_.data() + e->name_begin_, text_.data() + e->name_end_) << "', ";
+
+        if (boost::get<string_ref>(&e->value_))
+            vis(string_ref(text_.data() + e->value_begin_, text_.data() + e->value_end_));
+        else
+            e->value_.apply_visitor(vis);
+
+        os << ']';
+    }
+
+    return os.str();
+}
+
+void statement_stat::bind(const string_ref& name, const bind_types_variant& val)
+{
+    if (monitored())
+        bindings_.add(0, name, val);
+}
+
 void statement_stat::bind(int col, const bind_types_variant& val)
 {
-    if (session_stat_->user_monitor())
+    if (monitored())
+        bindings_.add(col, string_ref(), val);
+}
+
+bool statement_stat::monitored()
+{
+    if (!decided_)
+    {
+        sampled_ = session_stat_->sample();
+        decided_ = true;
+    }
+
+    return sampled_;
+}
+
+bool statement_stat::finish_execution(double execution_time, bool ok)
+{
+    bool report = monitored() && session_stat_->reported(execution_time, ok);
+    decided_ = false;
+
+    if (!report)
     {
-        bindings_ << '[' << col << ", ";
-        dump_to_ostream vis(bindings_);
-        val.apply_visitor(vis);
-        bindings_ << ']';
+        prepare_time_ = 0.0;
+        bind_time_ = 0.0;
     }
+
+    return report;
 }
 
 void statement_stat::reset_bindings()
 {
-    if (session_stat_->user_monitor())
-        bindings_.str("");
+    bindings_.clear();
+}
+
+double statement_stat::thread_cpu_time()
+{
+#if defined(BOOST_CHRONO_HAS_THREAD_CLOCK)
+    return boost::chrono::duration<double>(boost::chrono::thread_clock::now().time_since_epoch()).count();
+#else
+    return -1.0;
+#endif
+}
+
+execution_phases statement_stat::take_phases(double execution_time, double cpu_start)
+{
+    execution_phases phases;
+    phases.prepare_time = prepare_time_;
+    phases.bind_time = bind_time_;
+    phases.execute_time = execution_time;
+    phases.connection = session_stat_->connection_id();
+    if (cpu_start >= 0)
+        phases.cpu_time = thread_cpu_time() - cpu_start;
+
+    prepare_time_ = 0.0;
+    bind_time_ = 0.0;
+    return phases;
+}
+
+void statement_stat::record_execution(double execution_time, bool ok)
+{
+    session_stat_->add_query_time(execution_time);
+
+    if (histogram_)
+    {
+        histogram_->record(execution_time);
+        if (!ok)
+            histogram_->record_error();
+    }
+}
+
+statement_stat::measure_bind::measure_bind(statement_stat* stat)
+  : stat_(stat)
+  , start_(0)
+{
+    if (stat_->monitored())
+        start_ = stat_clock::now();
+}
+
+statement_stat::measure_bind::~measure_bind()
+{
+    if (stat_->monitored())
+        stat_->bind_time_ += stat_clock::seconds_since(start_);
 }
 
 statement_stat::measure_query::measure_query(
-    statement_stat* stat, const std::string* query, result_ptr* r
+    statement_stat* stat, const std::string* query, statement_iface* st, result_ptr* r
   )
   : stat_(stat)
   , query_(query)
+  , st_(st)
   , r_(r)
+  , start_(0)
+  , cpu_start_(stat->monitored() && stat->parent_stat()->cpu_time() ? thread_cpu_time() : -1.0)
 {
-    stat_->timer_.start();
+    start_ = stat_clock::now();
 }
 
 statement_stat::measure_query::~measure_query() noexcept(false)
 {
-    boost::chrono::duration<double> seconds = boost::chrono::nanoseconds(stat_->timer_.elapsed().wall);
-    double execution_time = seconds.count();
-    stat_->session_stat_->add_query_time(execution_time);
+    double execution_time = stat_clock::seconds_since(start_);
+    stat_->record_execution(execution_time, !std::uncaught_exception());
 
-    if (stat_->session_stat_->user_monitor())
+    if (stat_->finish_execution(execution_time, !std::uncaught_exception()))
     {
         bool succeded = !std::uncaught_exception();
         uint64_t rows = succeded ? (*r_)->rows() : uint64_t(-1);
 
         try
         {
-            stat_->session_stat_->user_monitor()->query_executed(
-                query_->c_str(), stat_->bindings_.str(), succeded, execution_time, rows);
+            session_monitor* sm = stat_->session_stat_->user_monitor();
+            execution_phases phases = stat_->take_phases(execution_time, cpu_start_);
+
+            sm->query_executed(query_->c_str(), stat_->bindings_, succeded, execution_time, rows);
+
+            if (succeded)
+                *r_ = new measured_result(*r_, st_, stat_, query_, phases, cpu_start_);
+            else
+                sm->query_executed(query_->c_str(), stat_->bindings_, false, phases);
         }
         catch(...)
         {
@@ -109,25 +343,30 @@ statement_stat::measure_statement::measure_statement(
   : stat_(stat)
   , query_(query)
   , st_(st)
+  , start_(0)
+  , cpu_start_(stat->monitored() && stat->parent_stat()->cpu_time() ? thread_cpu_time() : -1.0)
 {
-    stat_->timer_.start();
+    start_ = stat_clock::now();
 }
 
 statement_stat::measure_statement::~measure_statement() noexcept(false)
 {
-    boost::chrono::duration<double> seconds = boost::chrono::nanoseconds(stat_->timer_.elapsed().wall);
-    double execution_time = seconds.count();
-    stat_->session_stat_->add_query_time(execution_time);
+    double execution_time = stat_clock::seconds_since(start_);
+    stat_->record_execution(execution_time, !std::uncaught_exception());
 
-    if (stat_->session_stat_->user_monitor())
+    if (stat_->finish_execution(execution_time, !std::uncaught_exception()))
     {
         bool succeded = !std::uncaught_exception();
         uint64_t affected = succeded ? st_->affected() : 0;
 
         try
         {
-            stat_->session_stat_->user_monitor()->statement_executed(
-                query_->c_str(), stat_->bindings_.str(), succeded, execution_time, affected);
+            session_monitor* sm = stat_->session_stat_->user_monitor();
+            execution_phases phases = stat_->take_phases(execution_time, cpu_start_);
+            phases.rows = affected;
+
+            sm->statement_executed(query_->c_str(), stat_->bindings_, succeded, execution_time, affected);
+            sm->statement_executed(query_->c_str(), stat_->bindings_, succeded, phases);
         }
         catch(...)
         {
@@ -2,21 +2,34 @@
 #define EDBA_BACKEND_STATISTICS_HPP
 
 #include <edba/session_monitor.hpp>
+#include <edba/backend/stat_clock.hpp>
+#include <edba/backend/latency_registry.hpp>
 #include <edba/types.hpp>
 
-#include <boost/timer/timer.hpp>
-
-#include <sstream>
+#include <string>
+#include <vector>
 
 namespace edba { namespace backend {
 
 /// Wrap provided user session_monitor object, forward notifications to monitor if it is not null
-/// Accumulate total time spent is database queries
+/// Accumulate total time spent is database queries and latency histograms of statements
 struct session_stat
 {
-    session_stat(session_monitor* sm)
+    session_stat(
+        session_monitor* sm
+      , const boost::shared_ptr<latency_registry>& latencies
+      , unsigned sample_rate = 1
+      , double slow_threshold = 0.0
+      , bool cpu_time = false
+      )
       : sm_(sm)
       , total_sec_(0.0)
+      , latencies_(latencies)
+      , sample_rate_(sample_rate)
+      , sample_counter_(0)
+      , slow_threshold_(slow_threshold)
+      , cpu_time_(cpu_time)
+      , connection_id_(0)
     {
     }
 
@@ -24,19 +37,19 @@ struct session_stat
     void transaction_started()
     {
         if (sm_)
-            sm_->transaction_started();
+            sm_->transaction_started(connection_id_);
     }
 
     void transaction_commited()
     {
         if (sm_)
-            sm_->transaction_committed();
+            sm_->transaction_committed(connection_id_);
     }
 
     void transaction_reverted()
     {
         if (sm_)
-            sm_->transaction_reverted();
+            sm_->transaction_reverted(connection_id_);
     }
 
     /// Return total time spent in queries
@@ -55,22 +68,109 @@ struct session_stat
         total_sec_ += sec;
     }
 
+    /// Return true if next execution should be reported to monitor, every sample_rate execution is reported
+    bool sample()
+    {
+        if (!sm_)
+            return false;
+
+        return sample_rate_ <= 1 || 0 == sample_counter_++ % sample_rate_;
+    }
+
+    /// Return true if execution that took \a sec seconds is slow enough to be reported to monitor.
+    /// Failed executions are reported regardless of time
+    bool reported(double sec, bool ok) const
+    {
+        return !ok || sec >= slow_threshold_;
+    }
+
+    /// Return true if CPU time of calling thread should be measured for reported executions
+    bool cpu_time() const
+    {
+        return cpu_time_;
+    }
+
+    /// Return identifier of connection reported with executions
+    std::size_t connection_id() const
+    {
+        return connection_id_;
+    }
+
+    void set_connection_id(std::size_t id)
+    {
+        connection_id_ = id;
+    }
+
+    /// Return histogram for statement \a q, null if statement is not tracked
+    boost::shared_ptr<latency_histogram> histogram(const string_ref& q)
+    {
+        return latencies_ ? latencies_->get(q) : boost::shared_ptr<latency_histogram>();
+    }
+
+    const boost::shared_ptr<latency_registry>& latencies() const
+    {
+        return latencies_;
+    }
+
+    /// Use \a latencies registry for statements that are put into cache afterwards
+    void set_latencies(const boost::shared_ptr<latency_registry>& latencies)
+    {
+        latencies_ = latencies;
+    }
+
 private:
     session_monitor* sm_;
     double total_sec_;
+    boost::shared_ptr<latency_registry> latencies_;
+    unsigned sample_rate_;
+    unsigned sample_counter_;
+    double slow_threshold_;
+    bool cpu_time_;
+    std::size_t connection_id_;
+};
+
+/// Values bound to statement kept in binary form. Strings are copied into internal buffer because
+/// bound string_ref may point to temporary. Text representation is built only on str() call.
+class EDBA_API captured_bindings : public bound_params
+{
+public:
+    void add(int col, const string_ref& name, const bind_types_variant& val);
+    void clear();
+
+    virtual size_t size() const;
+    virtual std::string str() const;
+
+private:
+    struct entry
+    {
+        int col_;                                 // Column index, 0 when value was bound by name
+        size_t name_begin_;                       // Range of name in text_
+        size_t name_end_;
+        bind_types_variant value_;                // Bound value, string_ref values refer to text_ by value_begin_, value_end_
+        size_t value_begin_;
+        size_t value_end_;
+    };
+
+    std::vector<entry> entries_;
+    std::string text_;                            // Buffer for names and string values
 };
 
 struct statement_stat
 {
+    /// Measure query execution. When monitor is attached result is replaced with wrapper that
+    /// measures fetching of rows and reports execution_phases when it is destroyed
     struct measure_query
     {
-        measure_query(statement_stat* stat, const std::string* query, result_ptr* r);
+        measure_query(statement_stat* stat, const std::string* query, statement_iface* st, result_ptr* r);
         ~measure_query() noexcept(false);
 
     private:
         statement_stat* stat_;
         const std::string* query_;
+        statement_iface* st_;
         result_ptr* r_;
+        stat_clock::time_point start_;
+        double cpu_start_;
     };
 
     struct measure_statement
@@ -82,10 +182,27 @@ struct statement_stat
         statement_stat* stat_;
         const std::string* query_;
         statement_iface* st_;
+        stat_clock::time_point start_;
+        double cpu_start_;
+    };
+
+    /// Measure time spent on binding value, clock is read only when monitor is attached
+    struct measure_bind
+    {
+        measure_bind(statement_stat* stat);
+        ~measure_bind();
+
+    private:
+        statement_stat* stat_;
+        stat_clock::time_point start_;
     };
 
     statement_stat(session_stat* st)
       : session_stat_(st)
+      , prepare_time_(0.0)
+      , bind_time_(0.0)
+      , decided_(false)
+      , sampled_(false)
     {
     }
 
@@ -94,21 +211,62 @@ struct statement_stat
 
     void reset_bindings();
 
+    /// Account time spent on preparing statement, it is reported with the next execution
+    void add_prepare_time(double sec)
+    {
+        prepare_time_ += sec;
+    }
+
+    /// Look up latency histogram of statement \a q. Called once when prepared statement is put into cache,
+    /// executions of other statements are not recorded in histograms
+    void track_latency(const string_ref& q)
+    {
+        histogram_ = session_stat_->histogram(q);
+    }
+
     session_stat* parent_stat() const
     {
         return session_stat_;
     }
 
+    const bound_params& bindings() const
+    {
+        return bindings_;
+    }
+
+    /// Return CPU time in seconds consumed by calling thread, -1 if platform doesn`t support thread clock
+    static double thread_cpu_time();
+
 private:
+    /// Return true if current execution is sampled for monitor. Decision is made once per execution,
+    /// on the first bind or at the start of execution, so unsampled executions don`t capture bindings
+    bool monitored();
+
+    /// Complete execution cycle, return true if execution should be reported to monitor
+    bool finish_execution(double execution_time, bool ok);
+
+    /// Fill phases preceding and including execution, reset accumulated prepare and bind times
+    execution_phases take_phases(double execution_time, double cpu_start);
+
+    /// Account execution time in session totals and in latency histogram of tracked statement
+    void record_execution(double execution_time, bool ok);
+
     /// Parent session statistics object
     session_stat* session_stat_;
 
-    /// Accumulator for string representation of bounded parameters
-    /// Used in session_monitor calls
-    std::ostringstream bindings_;
+    /// Bound parameters, used in session_monitor calls
+    captured_bindings bindings_;
+
+    /// Time spent on preparing and binding, not reported yet
+    double prepare_time_;
+    double bind_time_;
+
+    /// Latency histogram of statement, null if statement is not tracked
+    boost::shared_ptr<latency_histogram> histogram_;
 
-    /// Used to evaluate time spent in query or statement
-    boost::timer::cpu_timer timer_;
+    /// Sampling decision for current execution
+    bool decided_;
+    bool sampled_;
 };
 
 
@@ -2,8 +2,11 @@
 #define EDBA_DETAIL_BIND_BY_NAME_HELPER_HPP
 
 #include <edba/types.hpp>
+#include <edba/sql_literal.hpp>
 
 #include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/make_shared.hpp>
 #include <boost/unordered_map.hpp>
 #include <boost/range/algorithm/find.hpp>
 #include <boost/range/algorithm/find_if.hpp>
@@ -24,8 +27,34 @@ namespace edba { namespace detail {
         const std::vector<int>& idx = bind_by_name_helper_.name_to_idx(name); \
         BOOST_FOREACH(int col, idx) \
             bind_impl(col, v); \
+    } \
+    virtual void bind_impl(const sql_placeholder& p, bind_types_variant const& v) \
+    { \
+        unsigned long long columns = p.columns(); \
+        if (!columns) \
+            bind_impl(p.name(), v); \
+        for (int col = 1; columns; ++col, columns >>= 1) \
+        { \
+            if (columns & 1) \
+                bind_impl(col, v); \
+        } \
     }
 
+/// \brief Result of query parsing by bind_by_name_helper
+///
+/// Immutable after construction, so it can be shared between statements of different connections
+/// which use the same style of bind markers.
+struct query_template
+{
+    // Map from parameter name to parameter index, sorted by name
+    typedef std::vector< std::pair<std::string, int> > name_map_type;
+
+    name_map_type name_map_;    // Name to index map
+    std::string patched_query_; // Sql built from original by replacing bind parameters with appropriate for backend
+};
+
+typedef boost::shared_ptr<const query_template> query_template_ptr;
+
 /// \brief Provide implementation for statement::bind_impl(string_ref name, ...) using statement::bind_impl(int col, ...) method
 ///
 /// Parse sql query on construction, and extract all parameters marked as ':paramname', assign numbers for each parameter
@@ -44,14 +73,26 @@ class bind_by_name_helper
         }
     };
 
-    // Map from parameter name to parameter index
-    typedef std::vector< std::pair<std::string, int> > name_map_type;
+    typedef query_template::name_map_type name_map_type;
 
 public:
     typedef boost::function<void(std::ostream& os, int col)> print_func_type;
 
-    bind_by_name_helper(const string_ref& sql, const print_func_type& print_func)      
+    bind_by_name_helper(const string_ref& sql, const print_func_type& print_func)
+      : tpl_(parse(sql, print_func))
+    {
+    }
+
+    /// \brief Use already parsed query
+    explicit bind_by_name_helper(const query_template_ptr& tpl)
+      : tpl_(tpl)
     {
+    }
+
+    /// \brief Parse query and replace parameters with markers printed by \a print_func
+    static query_template_ptr parse(const string_ref& sql, const print_func_type& print_func)
+    {
+        boost::shared_ptr<query_template> tpl = boost::make_shared<query_template>();
         std::ostringstream patched_query;
         
         int idx = 1;
@@ -63,9 +104,9 @@ public:
             BOOST_AUTO(name, (boost::find_if<boost::return_begin_found>(rest, is_non_name_char())));
 
             // Push back new parameter into name map
-            name_map_.resize(name_map_.size() + 1);
-            name_map_.back().first.assign(name.begin(), name.end());
-            name_map_.back().second = idx;
+            tpl->name_map_.resize(tpl->name_map_.size() + 1);
+            tpl->name_map_.back().first.assign(name.begin(), name.end());
+            tpl->name_map_.back().second = idx;
 
             // Append parameter into patched sql
             print_func(patched_query, idx++);
@@ -76,9 +117,16 @@ public:
 
         // Sort entries in name map by name
         // We do this because we want to apply equal_range algorithm further
-        boost::sort(name_map_, string_ref_less());
+        boost::sort(tpl->name_map_, string_ref_less());
 
-        patched_query_ = patched_query.str();
+        tpl->patched_query_ = patched_query.str();
+        return tpl;
+    }
+
+    /// \brief Return parsed query, it can be shared with other statements
+    const query_template_ptr& get_template() const
+    {
+        return tpl_;
     }
 
     /// \brief Return query with binding markers suitable for backend.
@@ -86,13 +134,27 @@ public:
     /// Backend should execute this statement instead of original.
     const std::string& patched_query() const
     {
-        return patched_query_;
+        return tpl_->patched_query_;
     }
 
     /// \brief Return total number of bind parameters in query
     size_t bindings_count() const
     {
-        return name_map_.size();
+        return tpl_->name_map_.size();
+    }
+
+    /// \brief Return approximate memory in bytes held by parsed query and helper itself.
+    /// Parsed query is counted fully even if it is shared with other statements.
+    size_t memory_usage() const
+    {
+        size_t res = sizeof(*this) + sizeof(query_template) + tpl_->patched_query_.capacity()
+            + indices_.capacity() * sizeof(int)
+            + tpl_->name_map_.capacity() * sizeof(name_map_type::value_type);
+
+        BOOST_FOREACH(const name_map_type::value_type& entry, tpl_->name_map_)
+            res += entry.first.capacity();
+
+        return res;
     }
 
     /// \brief For the given parameter name return set of indices in patched query
@@ -101,7 +163,7 @@ public:
     {
         indices_.clear();
 
-        BOOST_AUTO(iter_pair, boost::equal_range(name_map_, name, string_ref_less()));
+        BOOST_AUTO(iter_pair, boost::equal_range(tpl_->name_map_, name, string_ref_less()));
 
         if (boost::empty(iter_pair))
             throw invalid_column(to_string(name));
@@ -114,7 +176,7 @@ public:
 
 private:
     // Return range from [next after semicolon, sql.end())
-    string_ref skip_until_semicolon(const string_ref& sql, std::ostream& patched_sql)
+    static string_ref skip_until_semicolon(const string_ref& sql, std::ostream& patched_sql)
     {
         string_ref semicolon = boost::find<boost::return_found_end>(sql, ':');
         patched_sql << boost::make_iterator_range(sql.begin(), semicolon.begin());
@@ -124,9 +186,7 @@ private:
     }
 
 private:
-    name_map_type name_map_;    // Name to index map
-
-    std::string patched_query_; // Sql built from original by replacing bind parameters with appropriate for backend
+    query_template_ptr tpl_;    // Parsed query, may be shared with other statements
 
     std::vector<int> indices_;  // Holder for indices return by name_to_idx, prevent for allocating 
                                 // memory on each name_to_idx call
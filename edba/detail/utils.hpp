@@ -160,6 +160,12 @@ struct ref_cnt : boost::noncopyable
     {
     }
 
+    // Called when last reference is released, objects that are reused instead of being deleted override it
+    virtual void destroy()
+    {
+        delete this;
+    }
+
     void add_ref()
     {
         ++cnt_;
@@ -170,7 +176,7 @@ struct ref_cnt : boost::noncopyable
         if (0 == --cnt_)
         {
             before_destroy();
-            delete this;
+            destroy();
         }
     }
 
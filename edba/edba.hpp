@@ -2,6 +2,7 @@
 #define EDBA_EDBA_HPP
 
 #include <edba/session_pool.hpp>
+#include <edba/routing_pool.hpp>
 #include <edba/session.hpp>
 #include <edba/transaction.hpp>
 
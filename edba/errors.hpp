@@ -123,6 +123,26 @@ public:
     }
 };
 
+/// \brief No session became free in session_pool before deadline of open call
+class EDBA_API pool_timeout : public edba_error
+{
+public:
+    pool_timeout()
+      : edba_error("edba::pool_timeout no free session in pool before deadline")
+    {
+    }
+};
+
+/// \brief Too many open calls of priority class are waiting for free session in session_pool
+class EDBA_API pool_overloaded : public edba_error
+{
+public:
+    pool_overloaded(std::string const &priority_class)
+      : edba_error("edba::pool_overloaded too many open calls of class " + priority_class + " are waiting")
+    {
+    }
+};
+
 }
 
 #endif
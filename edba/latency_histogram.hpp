@@ -0,0 +1,224 @@
+#ifndef EDBA_LATENCY_HISTOGRAM_HPP
+#define EDBA_LATENCY_HISTOGRAM_HPP
+
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+
+#include <string>
+#include <cstddef>
+
+namespace edba {
+
+///
+/// \brief Execution time percentiles of single statement
+///
+struct query_latency
+{
+    query_latency()
+      : count(0)
+      , errors(0)
+      , total_time(0.0)
+      , p50(0.0)
+      , p99(0.0)
+      , p999(0.0)
+      , max(0.0)
+    {
+    }
+
+    std::string query;          ///< Statement text
+    unsigned long long count;   ///< Number of executions
+    unsigned long long errors;  ///< Number of failed executions, they are counted in percentiles too
+    double total_time;          ///< Total execution time in seconds
+    double p50;                 ///< Median of execution time in seconds
+    double p99;                 ///< 99th percentile of execution time in seconds
+    double p999;                ///< 99.9th percentile of execution time in seconds
+    double max;                 ///< Maximum execution time in seconds
+};
+
+///
+/// \brief Log-linear histogram of durations that can be updated concurrently without locks
+///
+/// Durations are counted in nanoseconds. Each power of two range is split into 8 linear buckets, so value
+/// reported for percentile differs from exact one by no more than 1/16. Durations longer then 2^40 ns
+/// (about 18 minutes) are counted in the last bucket. All counters are updated with relaxed atomic operations.
+///
+class latency_histogram
+{
+public:
+    static const int sub_bucket_bits = 3;
+    static const int sub_buckets = 1 << sub_bucket_bits;
+    static const int max_bits = 40;
+    static const int buckets = (max_bits - sub_bucket_bits + 1) * sub_buckets;
+
+    latency_histogram()
+      : count_(0)
+      , errors_(0)
+      , total_ns_(0)
+      , max_ns_(0)
+    {
+        for (int i = 0; i < buckets; ++i)
+            counts_[i].store(0, boost::memory_order_relaxed);
+    }
+
+    ///
+    /// Count duration of \a sec seconds
+    ///
+    void record(double sec)
+    {
+        boost::uint64_t ns = sec > 0 ? static_cast<boost::uint64_t>(sec * 1e9) : 0;
+
+        counts_[bucket_index(ns)].fetch_add(1, boost::memory_order_relaxed);
+        count_.fetch_add(1, boost::memory_order_relaxed);
+        total_ns_.fetch_add(ns, boost::memory_order_relaxed);
+
+        boost::uint64_t max = max_ns_.load(boost::memory_order_relaxed);
+        while (ns > max && !max_ns_.compare_exchange_weak(max, ns, boost::memory_order_relaxed))
+            ;
+    }
+
+    ///
+    /// Count failed execution, its duration should be recorded separately
+    ///
+    void record_error()
+    {
+        errors_.fetch_add(1, boost::memory_order_relaxed);
+    }
+
+    ///
+    /// Return number of recorded durations
+    ///
+    unsigned long long count() const
+    {
+        return count_.load(boost::memory_order_relaxed);
+    }
+
+    ///
+    /// Return number of recorded errors
+    ///
+    unsigned long long errors() const
+    {
+        return errors_.load(boost::memory_order_relaxed);
+    }
+
+    ///
+    /// Return total of recorded durations in seconds
+    ///
+    double total_time() const
+    {
+        return total_ns_.load(boost::memory_order_relaxed) * 1e-9;
+    }
+
+    ///
+    /// Fill counters and percentiles of \a res
+    ///
+    void fill(query_latency& res) const
+    {
+        boost::uint64_t counts[buckets];
+        boost::uint64_t total = 0;
+        for (int i = 0; i < buckets; ++i)
+        {
+            counts[i] = counts_[i].load(boost::memory_order_relaxed);
+            total += counts[i];
+        }
+
+        res.count = total;
+        res.errors = errors();
+        res.total_time = total_ns_.load(boost::memory_order_relaxed) * 1e-9;
+        res.max = max_ns_.load(boost::memory_order_relaxed) * 1e-9;
+        res.p50 = percentile(counts, total, 0.5);
+        res.p99 = percentile(counts, total, 0.99);
+        res.p999 = percentile(counts, total, 0.999);
+    }
+
+    ///
+    /// Fill \a res with cumulative counts of durations not longer then each of \a n ascending \a bounds
+    /// given in seconds, like Prometheus histogram buckets do. Return total count, total time in seconds
+    /// is stored to \a sum. Precision is the same as for percentiles.
+    ///
+    unsigned long long cumulative_counts(const double* bounds, size_t n, unsigned long long* res, double& sum) const
+    {
+        unsigned long long total = 0;
+        size_t b = 0;
+        for (int i = 0; i < buckets; ++i)
+        {
+            double middle = bucket_middle(i) * 1e-9;
+            for (; b < n && middle > bounds[b]; ++b)
+                res[b] = total;
+
+            total += counts_[i].load(boost::memory_order_relaxed);
+        }
+
+        for (; b < n; ++b)
+            res[b] = total;
+
+        sum = total_ns_.load(boost::memory_order_relaxed) * 1e-9;
+        return total;
+    }
+
+    ///
+    /// Return index of bucket that counts \a ns
+    ///
+    static int bucket_index(boost::uint64_t ns)
+    {
+        if (ns < sub_buckets)
+            return static_cast<int>(ns);
+
+        int msb = 0;
+        for (boost::uint64_t v = ns; v >>= 1; )
+            ++msb;
+
+        if (msb >= max_bits)
+            return buckets - 1;
+
+        int shift = msb - sub_bucket_bits;
+        return (shift + 1) * sub_buckets + static_cast<int>((ns >> shift) - sub_buckets);
+    }
+
+    ///
+    /// Return middle of range of nanoseconds counted by bucket \a idx
+    ///
+    static double bucket_middle(int idx)
+    {
+        if (idx < sub_buckets)
+            return idx;
+
+        int shift = idx / sub_buckets - 1;
+        boost::uint64_t lower = boost::uint64_t(idx % sub_buckets + sub_buckets) << shift;
+        return lower + ((boost::uint64_t(1) << shift) - 1) / 2.0;
+    }
+
+private:
+    static double percentile(const boost::uint64_t* counts, boost::uint64_t total, double p)
+    {
+        if (!total)
+            return 0.0;
+
+        boost::uint64_t rank = static_cast<boost::uint64_t>(p * total);
+        if (rank >= total)
+            rank = total - 1;
+
+        boost::uint64_t seen = 0;
+        for (int i = 0; i < buckets; ++i)
+        {
+            seen += counts[i];
+            if (seen > rank)
+                return bucket_middle(i) * 1e-9;
+        }
+
+        return bucket_middle(buckets - 1) * 1e-9;
+    }
+
+    // NONCOPYABLE
+    latency_histogram(const latency_histogram&);
+    latency_histogram& operator=(const latency_histogram&);
+
+    boost::atomic<boost::uint64_t> counts_[buckets];
+    boost::atomic<boost::uint64_t> count_;
+    boost::atomic<boost::uint64_t> errors_;
+    boost::atomic<boost::uint64_t> total_ns_;
+    boost::atomic<boost::uint64_t> max_ns_;
+};
+
+}
+
+#endif // EDBA_LATENCY_HISTOGRAM_HPP
@@ -0,0 +1,136 @@
+#include <edba/prometheus.hpp>
+
+#include <sstream>
+
+namespace edba {
+
+namespace {
+
+// Upper bounds of execution time histogram buckets in seconds
+const double bucket_bounds[] = {
+    0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10
+};
+const size_t buckets_count = sizeof(bucket_bounds) / sizeof(bucket_bounds[0]);
+
+void write_header(std::ostream& os, const char* prefix, const char* name, const char* type, const char* help)
+{
+    os << "# HELP " << prefix << '_' << name << ' ' << help << '\n';
+    os << "# TYPE " << prefix << '_' << name << ' ' << type << '\n';
+}
+
+template<typename T>
+void write_metric(std::ostream& os, const char* prefix, const char* name, const char* type, const char* help, T value)
+{
+    write_header(os, prefix, name, type, help);
+    os << prefix << '_' << name << ' ' << value << '\n';
+}
+
+// Write label value escaping backslash, double quote and line feed
+void write_label(std::ostream& os, const std::string& value)
+{
+    for (std::string::const_iterator c = value.begin(); c != value.end(); ++c)
+    {
+        if ('\\' == *c)
+            os << "\\\\";
+        else if ('"' == *c)
+            os << "\\\"";
+        else if ('\n' == *c)
+            os << "\\n";
+        else
+            os << *c;
+    }
+}
+
+void write_statements(std::ostream& os, const char* prefix, const backend::latency_registry& registry)
+{
+    std::vector<backend::latency_registry::entry> statements;
+    registry.snapshot(statements);
+
+    if (statements.empty())
+        return;
+
+    write_header(os, prefix, "statement_duration_seconds", "histogram", "Execution time of statement");
+    for (size_t i = 0; i < statements.size(); ++i)
+    {
+        unsigned long long counts[buckets_count];
+        double sum = 0.0;
+        unsigned long long total = statements[i].second->cumulative_counts(bucket_bounds, buckets_count, counts, sum);
+
+        for (size_t b = 0; b < buckets_count; ++b)
+        {
+            os << prefix << "_statement_duration_seconds_bucket{query=\"";
+            write_label(os, *statements[i].first);
+            os << "\",le=\"" << bucket_bounds[b] << "\"} " << counts[b] << '\n';
+        }
+
+        os << prefix << "_statement_duration_seconds_bucket{query=\"";
+        write_label(os, *statements[i].first);
+        os << "\",le=\"+Inf\"} " << total << '\n';
+
+        os << prefix << "_statement_duration_seconds_sum{query=\"";
+        write_label(os, *statements[i].first);
+        os << "\"} " << sum << '\n';
+
+        os << prefix << "_statement_duration_seconds_count{query=\"";
+        write_label(os, *statements[i].first);
+        os << "\"} " << total << '\n';
+    }
+
+    write_header(os, prefix, "statement_errors_total", "counter", "Number of failed executions of statement");
+    for (size_t i = 0; i < statements.size(); ++i)
+    {
+        os << prefix << "_statement_errors_total{query=\"";
+        write_label(os, *statements[i].first);
+        os << "\"} " << statements[i].second->errors() << '\n';
+    }
+}
+
+}
+
+void write_prometheus(std::ostream& os, session_pool& pool, const char* prefix)
+{
+    session_pool_stat st = pool.stat();
+
+    std::streamsize precision = os.precision(9);
+
+    write_metric(os, prefix, "pool_connections_max", "gauge", "Maximum number of connections in pool", st.max_size);
+    write_metric(os, prefix, "pool_connections_open", "gauge", "Number of connections opened by pool", st.open);
+    write_metric(os, prefix, "pool_connections_idle", "gauge", "Number of connections not used by sessions", st.idle);
+    write_metric(os, prefix, "pool_borrows_total", "counter", "Number of sessions taken from pool", st.borrows);
+    write_metric(os, prefix, "pool_timeouts_total", "counter", "Number of open calls that gave up waiting for free session", st.timeouts);
+    write_metric(os, prefix, "pool_recycled_total", "counter", "Number of connections retired because of max lifetime or max uses", st.recycled);
+    write_metric(os, prefix, "pool_affinity_hits_total", "counter", "Number of open calls with affinity key that got connection which served the key", st.affinity_hits);
+    write_metric(os, prefix, "pool_affinity_misses_total", "counter", "Number of open calls with affinity key that got other connection", st.affinity_misses);
+    write_metric(os, prefix, "pool_rejected_total", "counter", "Number of open calls rejected because too many calls of their class were waiting", st.rejected);
+
+    // Count of histogram is the number of waits, sum is the time spent waiting
+    unsigned long long waits[buckets_count];
+    double wait_sum = 0.0;
+    unsigned long long waits_total = pool.wait_histogram().cumulative_counts(bucket_bounds, buckets_count, waits, wait_sum);
+
+    write_header(os, prefix, "pool_wait_seconds", "histogram", "Time spent by open calls waiting for free session");
+    for (size_t b = 0; b < buckets_count; ++b)
+        os << prefix << "_pool_wait_seconds_bucket{le=\"" << bucket_bounds[b] << "\"} " << waits[b] << '\n';
+    os << prefix << "_pool_wait_seconds_bucket{le=\"+Inf\"} " << waits_total << '\n';
+    os << prefix << "_pool_wait_seconds_sum " << wait_sum << '\n';
+    os << prefix << "_pool_wait_seconds_count " << waits_total << '\n';
+
+    write_metric(os, prefix, "execution_seconds_total", "counter", "Time spent executing statements by returned sessions", st.execution_time);
+    write_metric(os, prefix, "statement_cache_hits_total", "counter", "Prepared statements taken from cache", st.cache.hits);
+    write_metric(os, prefix, "statement_cache_misses_total", "counter", "Prepared statements not found in cache", st.cache.misses);
+    write_metric(os, prefix, "statement_cache_evictions_total", "counter", "Prepared statements evicted from cache", st.cache.evictions);
+
+    if (boost::shared_ptr<const backend::latency_registry> registry = pool.latency_histograms())
+        write_statements(os, prefix, *registry);
+
+    os.precision(precision);
+}
+
+std::string prometheus_text(session_pool& pool, const char* prefix)
+{
+    std::ostringstream os;
+    write_prometheus(os, pool, prefix);
+    return os.str();
+}
+
+}
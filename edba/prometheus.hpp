@@ -0,0 +1,30 @@
+#ifndef EDBA_PROMETHEUS_HPP
+#define EDBA_PROMETHEUS_HPP
+
+#include <edba/session_pool.hpp>
+
+#include <ostream>
+#include <string>
+
+namespace edba {
+
+///
+/// Write metrics of \a pool to \a os in Prometheus text exposition format (version 0.0.4). Names of metrics start with \a prefix.
+///
+/// Pool metrics: connections limit, open and idle connections, borrows, histogram of waits for free connection,
+/// total execution time and statement cache counters. Per statement metrics, labeled by statement text: execution time
+/// histogram and errors counter, they are written only when \@stmt_latency_limit option is not 0.
+///
+/// Pool lock is held only while counters are copied, histograms are read without locks, so rendering doesn`t
+/// block threads that execute queries.
+///
+EDBA_API void write_prometheus(std::ostream& os, session_pool& pool, const char* prefix = "edba");
+
+///
+/// Return metrics of \a pool in Prometheus text exposition format, see write_prometheus
+///
+EDBA_API std::string prometheus_text(session_pool& pool, const char* prefix = "edba");
+
+}
+
+#endif // EDBA_PROMETHEUS_HPP
@@ -0,0 +1,379 @@
+#include <edba/query_stats.hpp>
+
+#include <algorithm>
+#include <cctype>
+
+namespace edba {
+
+namespace {
+
+// Number of shards, each has own lock
+const size_t shards_count = 16;
+
+// Limit for number of memoized normalizations per shard, memo is dropped when limit is reached
+const size_t max_memo_size = 1024;
+
+bool is_ident_char(char c)
+{
+    return std::isalnum(static_cast<unsigned char>(c)) || '_' == c;
+}
+
+bool is_digit(char c)
+{
+    return std::isdigit(static_cast<unsigned char>(c)) != 0;
+}
+
+// Check for IN keyword at position i
+bool is_in_keyword(const std::string& q, size_t i)
+{
+    return i + 1 < q.size()
+        && ('i' == q[i] || 'I' == q[i])
+        && ('n' == q[i + 1] || 'N' == q[i + 1])
+        && (0 == i || !is_ident_char(q[i - 1]))
+        && (i + 2 == q.size() || !is_ident_char(q[i + 2]));
+}
+
+// Replace IN (?, ?, ?) with IN (...)
+void collapse_in_lists(std::string& q)
+{
+    std::string res;
+    res.reserve(q.size());
+
+    size_t i = 0;
+    while (i < q.size())
+    {
+        if (is_in_keyword(q, i))
+        {
+            size_t open = i + 2;
+            if (open < q.size() && ' ' == q[open])
+                ++open;
+
+            if (open < q.size() && '(' == q[open])
+            {
+                size_t close = open + 1;
+                bool markers = false;
+                while (close < q.size() && (',' == q[close] || ' ' == q[close] || '?' == q[close]))
+                {
+                    markers = markers || '?' == q[close];
+                    ++close;
+                }
+
+                if (markers && close < q.size() && ')' == q[close])
+                {
+                    res.append(q, i, open - i);
+                    res += "(...)";
+                    i = close + 1;
+                    continue;
+                }
+            }
+        }
+
+        res += q[i++];
+    }
+
+    q.swap(res);
+}
+
+}
+
+std::string normalize_query(const string_ref& sql)
+{
+    std::string res;
+    res.reserve(sql.size());
+
+    const char* p = sql.begin();
+    const char* e = sql.end();
+    bool space = false;
+
+    while (p != e)
+    {
+        char c = *p;
+
+        if (std::isspace(static_cast<unsigned char>(c)))
+        {
+            space = true;
+            ++p;
+            continue;
+        }
+
+        if ('-' == c && p + 1 != e && '-' == p[1])
+        {
+            p = std::find(p, e, '\n');
+            space = true;
+            continue;
+        }
+
+        if ('/' == c && p + 1 != e && '*' == p[1])
+        {
+            const char end_marker[] = "*/";
+            p = std::search(p + 2, e, end_marker, end_marker + 2);
+            p = p == e ? e : p + 2;
+            space = true;
+            continue;
+        }
+
+        if (space && !res.empty())
+            res += ' ';
+        space = false;
+
+        if ('\'' == c)
+        {
+            // String literal, quote inside it is escaped by doubling
+            for (++p; p != e; ++p)
+            {
+                if ('\'' != *p)
+                    continue;
+
+                if (p + 1 != e && '\'' == p[1])
+                    ++p;
+                else
+                {
+                    ++p;
+                    break;
+                }
+            }
+
+            res += '?';
+        }
+        else if ('"' == c || '`' == c)
+        {
+            // Quoted identifier is kept as is
+            const char* end = std::find(p + 1, e, c);
+            end = end == e ? e : end + 1;
+            res.append(p, end);
+            p = end;
+        }
+        else if ((is_digit(c) || ('.' == c && p + 1 != e && is_digit(p[1]))) && (res.empty() || !is_ident_char(res[res.size() - 1])))
+        {
+            // Numeric literal, including hex and exponent forms
+            for (++p; p != e; ++p)
+            {
+                if (is_ident_char(*p) || '.' == *p)
+                    continue;
+
+                if (('+' == *p || '-' == *p) && ('e' == p[-1] || 'E' == p[-1]))
+                    continue;
+
+                break;
+            }
+
+            res += '?';
+        }
+        else if (('$' == c || ':' == c || '@' == c) && p + 1 != e && is_ident_char(p[1]) && (':' != c || res.empty() || ':' != res[res.size() - 1]))
+        {
+            // Bind markers like $1, :1, :name, @name. Postgresql cast :: is not a marker
+            for (++p; p != e && is_ident_char(*p); ++p)
+                ;
+
+            res += '?';
+        }
+        else
+        {
+            res += c;
+            ++p;
+        }
+    }
+
+    collapse_in_lists(res);
+    return res;
+}
+
+struct query_stats::shard
+{
+    shard() : dropped(0) {}
+
+    // Raw query text to fingerprint map
+    typedef boost::unordered_map<std::string, std::size_t, string_ref_hash, string_ref_equal> fingerprints_map;
+    typedef boost::unordered_map<std::size_t, query_fingerprint_stat> stats_map;
+
+    mutable boost::mutex guard;
+    fingerprints_map fingerprints;                // Memoized normalization of queries which raw text hash belongs to shard
+    stats_map stats;                              // Statistics of queries which fingerprint belongs to shard
+    unsigned long long dropped;
+};
+
+query_stats::query_stats(session_monitor* next, size_t max_queries)
+  : next_(next)
+  , max_queries_per_shard_((max_queries + shards_count - 1) / shards_count)
+  , shards_(new shard[shards_count])
+{
+}
+
+query_stats::~query_stats()
+{
+}
+
+void query_stats::record(const char* sql, bool ok, const execution_phases& phases)
+{
+    string_ref q(sql);
+    std::string normalized;
+    std::size_t fingerprint = 0;
+
+    shard& memo = shards_[string_ref_hash()(q) % shards_count];
+    bool memoized = false;
+    {
+        boost::mutex::scoped_lock g(memo.guard);
+        shard::fingerprints_map::const_iterator found = memo.fingerprints.find(q, string_ref_hash(), string_ref_equal());
+        if (memo.fingerprints.end() != found)
+        {
+            fingerprint = found->second;
+            memoized = true;
+        }
+    }
+
+    if (!memoized)
+    {
+        normalized = normalize_query(q);
+        fingerprint = string_ref_hash()(normalized);
+
+        boost::mutex::scoped_lock g(memo.guard);
+        if (memo.fingerprints.size() >= max_memo_size)
+            memo.fingerprints.clear();
+
+        memo.fingerprints.insert(std::make_pair(std::string(sql), fingerprint));
+    }
+
+    shard& s = shards_[fingerprint % shards_count];
+    boost::mutex::scoped_lock g(s.guard);
+
+    shard::stats_map::iterator found = s.stats.find(fingerprint);
+    if (s.stats.end() == found)
+    {
+        if (s.stats.size() >= max_queries_per_shard_)
+        {
+            ++s.dropped;
+            return;
+        }
+
+        // Statistics may have been reset after normalization was memoized
+        if (normalized.empty())
+            normalized = normalize_query(q);
+
+        found = s.stats.insert(std::make_pair(fingerprint, query_fingerprint_stat())).first;
+        found->second.fingerprint = fingerprint;
+        found->second.query.swap(normalized);
+        found->second.min_time = phases.execute_time;
+    }
+
+    query_fingerprint_stat& st = found->second;
+    ++st.calls;
+    if (!ok)
+        ++st.errors;
+    st.rows += phases.rows;
+    st.total_time += phases.execute_time;
+    st.min_time = (std::min)(st.min_time, phases.execute_time);
+    st.max_time = (std::max)(st.max_time, phases.execute_time);
+}
+
+namespace {
+
+bool heavier(const query_fingerprint_stat& s1, const query_fingerprint_stat& s2)
+{
+    return s1.total_time > s2.total_time;
+}
+
+}
+
+std::vector<query_fingerprint_stat> query_stats::top(size_t n) const
+{
+    std::vector<query_fingerprint_stat> res;
+
+    for (size_t i = 0; i < shards_count; ++i)
+    {
+        boost::mutex::scoped_lock g(shards_[i].guard);
+        for (shard::stats_map::const_iterator st = shards_[i].stats.begin(); st != shards_[i].stats.end(); ++st)
+            res.push_back(st->second);
+    }
+
+    if (res.size() > n)
+    {
+        std::partial_sort(res.begin(), res.begin() + n, res.end(), &heavier);
+        res.resize(n);
+    }
+    else
+        std::sort(res.begin(), res.end(), &heavier);
+
+    return res;
+}
+
+unsigned long long query_stats::dropped() const
+{
+    unsigned long long res = 0;
+    for (size_t i = 0; i < shards_count; ++i)
+    {
+        boost::mutex::scoped_lock g(shards_[i].guard);
+        res += shards_[i].dropped;
+    }
+
+    return res;
+}
+
+void query_stats::reset()
+{
+    for (size_t i = 0; i < shards_count; ++i)
+    {
+        boost::mutex::scoped_lock g(shards_[i].guard);
+        shards_[i].stats.clear();
+        shards_[i].dropped = 0;
+    }
+}
+
+void query_stats::statement_executed(const char* sql, const bound_params& bindings, bool ok, double execution_time, unsigned long long rows_affected)
+{
+    if (next_)
+        next_->statement_executed(sql, bindings, ok, execution_time, rows_affected);
+}
+
+void query_stats::query_executed(const char* sql, const bound_params& bindings, bool ok, double execution_time, unsigned long long rows_read)
+{
+    if (next_)
+        next_->query_executed(sql, bindings, ok, execution_time, rows_read);
+}
+
+void query_stats::statement_executed(const char* sql, const bound_params& bindings, bool ok, const execution_phases& phases)
+{
+    record(sql, ok, phases);
+
+    if (next_)
+        next_->statement_executed(sql, bindings, ok, phases);
+}
+
+void query_stats::query_executed(const char* sql, const bound_params& bindings, bool ok, const execution_phases& phases)
+{
+    record(sql, ok, phases);
+
+    if (next_)
+        next_->query_executed(sql, bindings, ok, phases);
+}
+
+void query_stats::transaction_started(std::size_t connection)
+{
+    if (next_)
+        next_->transaction_started(connection);
+}
+
+void query_stats::transaction_committed(std::size_t connection)
+{
+    if (next_)
+        next_->transaction_committed(connection);
+}
+
+void query_stats::transaction_reverted(std::size_t connection)
+{
+    if (next_)
+        next_->transaction_reverted(connection);
+}
+
+void query_stats::session_opened(std::size_t connection, double wait_time)
+{
+    if (next_)
+        next_->session_opened(connection, wait_time);
+}
+
+void query_stats::session_closed(std::size_t connection)
+{
+    if (next_)
+        next_->session_closed(connection);
+}
+
+}
@@ -0,0 +1,109 @@
+#ifndef EDBA_QUERY_STATS_HPP
+#define EDBA_QUERY_STATS_HPP
+
+#include <edba/session_monitor.hpp>
+#include <edba/string_ref.hpp>
+#include <edba/detail/exports.hpp>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_array.hpp>
+
+#include <string>
+#include <vector>
+
+namespace edba {
+
+///
+/// \brief Aggregated statistics of queries that have the same normalized text
+///
+struct query_fingerprint_stat
+{
+    query_fingerprint_stat()
+      : fingerprint(0)
+      , calls(0)
+      , errors(0)
+      , rows(0)
+      , total_time(0.0)
+      , min_time(0.0)
+      , max_time(0.0)
+    {
+    }
+
+    std::size_t fingerprint;    ///< Hash of normalized query text
+    std::string query;          ///< Normalized query text
+    unsigned long long calls;   ///< Number of executions
+    unsigned long long errors;  ///< Number of failed executions
+    unsigned long long rows;    ///< Total rows fetched by queries or affected by statements
+    double total_time;          ///< Total execution time in seconds
+    double min_time;            ///< Minimal execution time in seconds
+    double max_time;            ///< Maximal execution time in seconds
+};
+
+///
+/// Return \a sql with string and numeric literals and bind markers replaced by ?, comments removed,
+/// whitespaces collapsed and lists like IN (?, ?, ?) collapsed to IN (...). Queries that differ only by
+/// literal values have the same normalized text.
+///
+EDBA_API std::string normalize_query(const string_ref& sql);
+
+///
+/// \brief session_monitor that aggregates execution statistics per normalized query text
+///
+/// Similar to pg_stat_statements, but works on client side for any backend. Statistics is kept in sharded
+/// map, so sessions used from different threads rarely contend on the same lock. Normalization of query text
+/// is done once per distinct text, results are memoized. All events are forwarded to \a next monitor if it is set.
+///
+/// session_pool creates it for its sessions when \@query_stats connection option is on, see session_pool::top_queries.
+/// Only executions reported to monitor are counted, so session_pool rejects \@query_stats together with
+/// \@monitor_sample_rate or \@monitor_slow_ms.
+///
+class EDBA_API query_stats : public session_monitor, boost::noncopyable
+{
+public:
+    ///
+    /// Create aggregator that keeps statistics of at most \a max_queries distinct normalized queries,
+    /// executions of other queries are counted only by dropped().
+    ///
+    explicit query_stats(session_monitor* next = 0, size_t max_queries = 5000);
+    ~query_stats();
+
+    ///
+    /// Return statistics of at most \a n queries with largest total execution time
+    ///
+    std::vector<query_fingerprint_stat> top(size_t n) const;
+
+    ///
+    /// Return number of executions that were not accounted because of max_queries limit
+    ///
+    unsigned long long dropped() const;
+
+    ///
+    /// Drop all statistics
+    ///
+    void reset();
+
+    virtual void statement_executed(const char* sql, const bound_params& bindings, bool ok, double execution_time, unsigned long long rows_affected);
+    virtual void query_executed(const char* sql, const bound_params& bindings, bool ok, double execution_time, unsigned long long rows_read);
+    virtual void statement_executed(const char* sql, const bound_params& bindings, bool ok, const execution_phases& phases);
+    virtual void query_executed(const char* sql, const bound_params& bindings, bool ok, const execution_phases& phases);
+    virtual void transaction_started(std::size_t connection);
+    virtual void transaction_committed(std::size_t connection);
+    virtual void transaction_reverted(std::size_t connection);
+    virtual void session_opened(std::size_t connection, double wait_time);
+    virtual void session_closed(std::size_t connection);
+
+private:
+    struct shard;
+
+    void record(const char* sql, bool ok, const execution_phases& phases);
+
+    session_monitor* next_;
+    size_t max_queries_per_shard_;
+    boost::scoped_array<shard> shards_;
+};
+
+}
+
+#endif // EDBA_QUERY_STATS_HPP
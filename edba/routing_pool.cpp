@@ -0,0 +1,251 @@
+#include <edba/routing_pool.hpp>
+#include <edba/errors.hpp>
+
+#include <boost/chrono/chrono.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/foreach.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace edba {
+
+namespace {
+
+// Replica that failed to connect is not used during this time
+const boost::chrono::seconds retry_delay(1);
+
+// Latency of replica is recalculated not more often than this
+const boost::chrono::milliseconds refresh_interval(100);
+
+boost::int64_t steady_now_ns()
+{
+    return boost::chrono::duration_cast<boost::chrono::nanoseconds>(boost::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+std::vector<conn_info> parse_endpoints(const std::vector<std::string>& conn_strings)
+{
+    std::vector<conn_info> res;
+    BOOST_FOREACH(const std::string& s, conn_strings)
+        res.push_back(conn_info(s));
+
+    return res;
+}
+
+}
+
+// Pool of one endpoint and moving average of execution time of its statements
+struct routing_pool::endpoint
+{
+    endpoint(const conn_info& ci, int max_pool_size, session_monitor* sm)
+      : pool(ci, max_pool_size, sm)
+      , latency_ns(0)
+      , down_until_ns(0)
+      , refresh_at_ns(0)
+      , seen_count(0)
+      , seen_time(0.0)
+    {
+    }
+
+    bool available(boost::int64_t now_ns) const
+    {
+        return down_until_ns.load(boost::memory_order_relaxed) <= now_ns;
+    }
+
+    void mark_down()
+    {
+        down_until_ns.store(steady_now_ns() + boost::chrono::nanoseconds(retry_delay).count(), boost::memory_order_relaxed);
+    }
+
+    // Average execution time since previous refresh is taken from latency histograms of pool
+    void refresh_latency(boost::int64_t now_ns)
+    {
+        if (refresh_at_ns.load(boost::memory_order_relaxed) > now_ns)
+            return;
+
+        boost::mutex::scoped_lock g(refresh_guard, boost::try_to_lock);
+        boost::shared_ptr<const backend::latency_registry> latencies = pool.latency_histograms();
+        if (!g.owns_lock() || !latencies)
+            return;
+
+        refresh_at_ns.store(now_ns + boost::chrono::nanoseconds(refresh_interval).count(), boost::memory_order_relaxed);
+
+        latencies->snapshot(histograms);
+        unsigned long long count = 0;
+        double time = 0.0;
+        BOOST_FOREACH(const backend::latency_registry::entry& e, histograms)
+        {
+            count += e.second->count();
+            time += e.second->total_time();
+        }
+
+        if (count > seen_count)
+        {
+            // Moving average with weight 1/4 of the last interval
+            boost::uint64_t ns = static_cast<boost::uint64_t>((time - seen_time) / (count - seen_count) * 1e9);
+            boost::uint64_t avg = latency_ns.load(boost::memory_order_relaxed);
+            latency_ns.store(avg ? avg - avg / 4 + ns / 4 : ns, boost::memory_order_relaxed);
+        }
+
+        seen_count = count;
+        seen_time = time;
+    }
+
+    session_pool pool;
+    boost::atomic<boost::uint64_t> latency_ns;    // Moving average of execution time
+    boost::atomic<boost::int64_t> down_until_ns;  // Endpoint is skipped until this time after connection failure
+    boost::atomic<boost::int64_t> refresh_at_ns;  // Time of next refresh of latency_ns
+
+    boost::mutex refresh_guard;                   // Guard fields below, refresh is skipped if it is locked
+    std::vector<backend::latency_registry::entry> histograms;
+    unsigned long long seen_count;
+    double seen_time;
+};
+
+routing_pool::routing_pool(const char* primary, const std::vector<std::string>& replicas, int max_pool_size, session_monitor* sm)
+    : routing_pool(conn_info(primary), parse_endpoints(replicas), max_pool_size, sm)
+{
+}
+
+routing_pool::routing_pool(const conn_info& primary, const std::vector<conn_info>& replicas, int max_pool_size, session_monitor* sm)
+    : primary_(new endpoint(primary, max_pool_size, sm))
+    , next_replica_(0)
+    , primary_reads_(0)
+{
+    try
+    {
+        BOOST_FOREACH(const conn_info& ci, replicas)
+            replicas_.push_back(new endpoint(ci, max_pool_size, sm));
+    }
+    catch(...)
+    {
+        BOOST_FOREACH(endpoint* e, replicas_)
+            delete e;
+
+        delete primary_;
+        throw;
+    }
+}
+
+routing_pool::~routing_pool()
+{
+    BOOST_FOREACH(endpoint* e, replicas_)
+        delete e;
+
+    delete primary_;
+}
+
+session routing_pool::open_write()
+{
+    return primary_->pool.open();
+}
+
+session routing_pool::open_read()
+{
+    session sess;
+
+    endpoint* best = least_loaded();
+    if (best && try_read(best, sess))
+        return sess;
+
+    // Least loaded replica has no free session, any other replica will do
+    boost::int64_t now = steady_now_ns();
+    BOOST_FOREACH(endpoint* r, replicas_)
+    {
+        if (r != best && r->available(now) && try_read(r, sess))
+            return sess;
+    }
+
+    if (primary_->pool.try_open(sess))
+    {
+        primary_reads_.fetch_add(1, boost::memory_order_relaxed);
+        return sess;
+    }
+
+    if (best && best->available(steady_now_ns()))
+    {
+        try
+        {
+            return best->pool.open();
+        }
+        catch(edba_error&)
+        {
+            best->mark_down();
+        }
+    }
+
+    primary_reads_.fetch_add(1, boost::memory_order_relaxed);
+    return primary_->pool.open();
+}
+
+routing_pool::endpoint* routing_pool::least_loaded()
+{
+    if (replicas_.empty())
+        return 0;
+
+    boost::int64_t now = steady_now_ns();
+    size_t start = next_replica_.fetch_add(1, boost::memory_order_relaxed);
+
+    endpoint* best = 0;
+    for (size_t i = 0; i < replicas_.size(); ++i)
+    {
+        endpoint* r = replicas_[(start + i) % replicas_.size()];
+        if (!r->available(now))
+            continue;
+
+        r->refresh_latency(now);
+
+        if (!best)
+        {
+            best = r;
+            continue;
+        }
+
+        int busy = r->pool.busy();
+        int best_busy = best->pool.busy();
+        if (busy < best_busy || (busy == best_busy && r->latency_ns.load(boost::memory_order_relaxed) < best->latency_ns.load(boost::memory_order_relaxed)))
+            best = r;
+    }
+
+    return best;
+}
+
+bool routing_pool::try_read(endpoint* replica, session& sess)
+{
+    try
+    {
+        return replica->pool.try_open(sess);
+    }
+    catch(edba_error&)
+    {
+        replica->mark_down();
+        return false;
+    }
+}
+
+void routing_pool::invoke_on_connect(const session_pool::conn_init_callback& callback)
+{
+    primary_->pool.invoke_on_connect(callback);
+    BOOST_FOREACH(endpoint* e, replicas_)
+        e->pool.invoke_on_connect(callback);
+}
+
+session_pool& routing_pool::primary()
+{
+    return primary_->pool;
+}
+
+size_t routing_pool::replicas_count() const
+{
+    return replicas_.size();
+}
+
+session_pool& routing_pool::replica(size_t i)
+{
+    return replicas_.at(i)->pool;
+}
+
+unsigned long long routing_pool::primary_reads() const
+{
+    return primary_reads_.load(boost::memory_order_relaxed);
+}
+
+}
@@ -0,0 +1,83 @@
+#ifndef EDBA_ROUTING_POOL_HPP
+#define EDBA_ROUTING_POOL_HPP
+
+#include <edba/session_pool.hpp>
+#include <edba/detail/exports.hpp>
+
+#include <boost/atomic.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <string>
+#include <vector>
+
+namespace edba {
+
+///
+/// \brief Pool of sessions to primary database and its read replicas
+///
+/// Keeps session_pool of \a max_pool_size connections for each endpoint. open_write() always takes session to primary.
+/// open_read() takes session to replica with least number of sessions currently taken from it, replicas with equal
+/// number are ordered by moving average of statements execution time taken from latency histograms of their pools,
+/// so it is not used when \@stmt_latency_limit is 0. When all replicas are busy or can`t be connected, open_read()
+/// takes free session to primary, and waits for least loaded replica only when primary has no free session either.
+/// Replica that failed to connect is skipped for one second.
+///
+/// Pools of all endpoints are monitored by \a sm if it is set.
+///
+class EDBA_API routing_pool : boost::noncopyable
+{
+public:
+    routing_pool(const char* primary, const std::vector<std::string>& replicas, int max_pool_size, session_monitor* sm = 0);
+    routing_pool(const conn_info& primary, const std::vector<conn_info>& replicas, int max_pool_size, session_monitor* sm = 0);
+    ~routing_pool();
+
+    ///
+    /// Take session to primary, block if it has no free sessions
+    ///
+    session open_write();
+
+    ///
+    /// Take session to least loaded replica or to primary if no replica is available
+    ///
+    session open_read();
+
+    ///
+    /// Invoke \a callback once on creation of each connection to any endpoint
+    ///
+    void invoke_on_connect(const session_pool::conn_init_callback& callback);
+
+    ///
+    /// Return pool of primary endpoint
+    ///
+    session_pool& primary();
+
+    ///
+    /// Return number of replica endpoints
+    ///
+    size_t replicas_count() const;
+
+    ///
+    /// Return pool of replica \a i
+    ///
+    session_pool& replica(size_t i);
+
+    ///
+    /// Return number of open_read calls that were served by primary
+    ///
+    unsigned long long primary_reads() const;
+
+private:
+    struct endpoint;
+
+    endpoint* least_loaded();
+    bool try_read(endpoint* replica, session& sess);
+
+    endpoint* primary_;
+    std::vector<endpoint*> replicas_;
+    boost::atomic<size_t> next_replica_;          // Rotates first candidate among equally loaded replicas
+    boost::atomic<unsigned long long> primary_reads_;
+};
+
+}
+
+#endif // EDBA_ROUTING_POOL_HPP
@@ -69,6 +69,17 @@ public:
         return statement(conn_, stmt);
     }
 
+    /// Same as prepare_statement(q.str()), but query text hash and trimming are evaluated at compile time
+    /// for \a q created with _sql literal suffix.
+    statement prepare_statement(const sql_literal& q)
+    {
+        if (!conn_)
+            throw empty_session("prepare_statement");
+
+        backend::statement_ptr stmt(conn_->prepare_statement(q));
+        return statement(conn_, stmt);
+    }
+
     /// Create unprepared statement which is never cached. It should
     /// be used when such statement is executed rarely or very customized.
     statement create_statement(const string_ref& q)
@@ -147,6 +158,12 @@ public:
         conn_->rollback();
     }
 
+    /// Cheaply check that connection to server is alive. Return false if it is broken or session is empty.
+    bool ping()
+    {
+        return conn_ && conn_->ping();
+    }
+
     /// Escape a string \a s for inclusion in SQL statement. It does not add quotation marks at beginning and end.
     /// It is designed to be used with text, don't use it with generic binary data.
     ///    
@@ -217,6 +234,25 @@ public:
 
         return conn_->total_execution_time();
     }
+
+    /// Return counters of prepared statements cache of underlying connection
+    statement_cache_stat cache_stat() const
+    {
+        if (!conn_)
+            throw empty_session("cache_stat");
+
+        return conn_->cache_stat();
+    }
+
+    /// Return execution time percentiles of statements executed by underlying connection.
+    /// For sessions taken from session_pool percentiles are aggregated over all sessions of pool.
+    std::vector<query_latency> query_latencies() const
+    {
+        if (!conn_)
+            throw empty_session("query_latencies");
+
+        return conn_->query_latencies();
+    }
     
     const conn_info& connection_info() const
     {
@@ -238,6 +274,12 @@ public:
         return prepare_statement(query);
     }    
 
+    /// Syntactic sugar, same as prepare(q)
+    statement operator<<(const sql_literal& query)
+    {
+        return prepare_statement(query);
+    }
+
 private:
     friend class session_pool;
 
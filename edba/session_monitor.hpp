@@ -2,17 +2,115 @@
 #define EDBA_SESSION_MONITOR_HPP
 
 #include <string>
+#include <cstddef>
 
 namespace edba {
 
+///
+/// \brief Values bound to statement, captured for session_monitor
+///
+/// Values are kept in binary form and formatted to text only when str() is called.
+///
+class bound_params
+{
+public:
+    virtual ~bound_params() {}
+
+    ///
+    /// Return number of bound values
+    ///
+    virtual size_t size() const = 0;
+
+    ///
+    /// Format all bound values to text ready for logging. Empty string if there are no bindings
+    ///
+    virtual std::string str() const = 0;
+};
+
+///
+/// \brief Durations of statement execution phases reported to session_monitor
+///
+/// All times are in seconds of wall clock unless stated otherwise.
+///
+struct execution_phases
+{
+    execution_phases()
+      : prepare_time(0.0)
+      , bind_time(0.0)
+      , execute_time(0.0)
+      , first_row_time(0.0)
+      , fetch_time(0.0)
+      , rows(0)
+      , cpu_time(-1.0)
+      , connection(0)
+    {
+    }
+
+    double prepare_time;        ///< Time spent on preparing statement. Nonzero only for the first execution after statement was prepared
+    double bind_time;           ///< Time spent on binding values since previous execution
+    double execute_time;        ///< Time spent by backend on executing statement
+    double first_row_time;      ///< Time from the end of execution until the first row was fetched. 0 for statements
+    double fetch_time;          ///< Time from the end of execution until result was destroyed, includes rows processing by caller. 0 for statements
+    unsigned long long rows;    ///< Rows fetched by query or rows affected by statement
+    double cpu_time;            ///< CPU time of calling thread from the start of execution until result was destroyed, -1 if \@monitor_cpu_time is off or platform doesn`t support it.
+                                ///< Meaningless when query result is destroyed by another thread than the one that executed query
+    std::size_t connection;     ///< Identifier of connection that executed statement, the same that session_pool passes to session_opened
+};
+
 /// 
 /// \brief Interface for monitoring session statements executing
 ///
+/// Monitor may override either overloads of statement_executed and query_executed that receive
+/// bound values as text, or overloads that receive bound_params. The later are called by edba, by default
+/// they format bindings and call the former. Monitors that don`t need bindings or need them only occasionally
+/// should override bound_params overloads to avoid formatting cost.
+///
+/// Overloads that receive execution_phases are called additionally. For statements they are called right
+/// after execution, for queries they are called when all rows were fetched and result was destroyed.
+/// When \@monitor_cpu_time is on, comparing cpu_time with execute_time + fetch_time shows whether client spends time waiting for network and server
+/// or converting data.
+///
 class session_monitor
 {
 public:
     virtual ~session_monitor() {}
 
+    ///
+    /// Called after statement has been executed. 
+    /// \param bindings - values bound to statement
+    /// \param ok - false when error occurred
+    /// \param execution_time - time that has been taken to execute row
+    /// \param rows_affected - rows affected during execution. 0 on errors
+    ///
+    virtual void statement_executed(
+        const char*          sql
+      , const bound_params&  bindings
+      , bool                 ok
+      , double               execution_time
+      , unsigned long long   rows_affected
+      )
+    {
+        statement_executed(sql, bindings.str(), ok, execution_time, rows_affected);
+    }
+
+    ///
+    /// Called after query has been executed. 
+    /// \param bindings - values bound to statement
+    /// \param ok - false when error occurred
+    /// \param execution_time - time that has been taken to execute row
+    /// \param rows_read - rows read. 0 on errors
+    ///
+    virtual void query_executed(
+        const char*          sql
+      , const bound_params&  bindings
+      , bool                 ok
+      , double               execution_time
+      , unsigned long long   rows_read
+      )
+    {
+        query_executed(sql, bindings.str(), ok, execution_time, rows_read);
+    }
+
     ///
     /// Called after statement has been executed. 
     /// \param bindings - commaseparated list of bindings, ready for loggging. Empty if there are no bindings
@@ -45,9 +143,66 @@ public:
       )
     {}
 
+    ///
+    /// Called after statement has been executed with duration of each phase. 
+    /// \param bindings - values bound to statement
+    /// \param ok - false when error occurred
+    /// \param phases - durations of execution phases, rows affected
+    ///
+    virtual void statement_executed(
+        const char*              // sql
+      , const bound_params&      // bindings
+      , bool                     // ok
+      , const execution_phases&  // phases
+      )
+    {}
+
+    ///
+    /// Called when query result has been destroyed or when query execution has failed.
+    /// \param bindings - values bound to statement
+    /// \param ok - false when error occurred
+    /// \param phases - durations of execution phases, rows fetched
+    ///
+    virtual void query_executed(
+        const char*              // sql
+      , const bound_params&      // bindings
+      , bool                     // ok
+      , const execution_phases&  // phases
+      )
+    {}
+
     virtual void transaction_started() {}
     virtual void transaction_committed() {}
     virtual void transaction_reverted() {}
+
+    ///
+    /// Called by edba when transaction has been started, committed or reverted. By default they call overloads without
+    /// connection, monitors that need to know which connection runs transaction should override these.
+    /// \param connection - identifier of connection, the same as in execution_phases::connection
+    ///
+    virtual void transaction_started(std::size_t /* connection */) { transaction_started(); }
+    virtual void transaction_committed(std::size_t /* connection */) { transaction_committed(); }
+    virtual void transaction_reverted(std::size_t /* connection */) { transaction_reverted(); }
+
+    ///
+    /// Called by session_pool when session has been taken from pool.
+    /// \param connection - identifier of pooled connection
+    /// \param wait_time - time in seconds spent on waiting for free connection
+    ///
+    virtual void session_opened(
+        std::size_t          // connection
+      , double               // wait_time
+      )
+    {}
+
+    ///
+    /// Called by session_pool before session is returned to pool.
+    /// \param connection - identifier of pooled connection
+    ///
+    virtual void session_closed(
+        std::size_t          // connection
+      )
+    {}
 };
 
 }
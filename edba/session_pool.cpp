@@ -1,23 +1,206 @@
 #include <edba/session_pool.hpp>
+#include <edba/backend/stat_clock.hpp>
 #include <boost/bind/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/random/uniform_real_distribution.hpp>
+
+#include <algorithm>
+#include <exception>
+#include <limits>
+#include <ctime>
 
 namespace edba {
 
+namespace {
+
+// Number of affinity keys remembered by connection
+const int affinity_keys = 4;
+
+// Convert seconds to ticks of stat_clock
+backend::stat_clock::time_point clock_ticks(double sec)
+{
+    return static_cast<backend::stat_clock::time_point>(sec / backend::stat_clock::seconds(0, 1));
+}
+
+// Bit that represents affinity key in 64 bit mask of keys
+boost::uint64_t affinity_bit(std::size_t key)
+{
+    return boost::uint64_t(1) << ((boost::uint64_t(key) * 0x9E3779B97F4A7C15ULL) >> 58);
+}
+
+boost::atomic<unsigned> threads_count(0);
+
+// Sequential number of thread, used to choose its shard of sharded pool
+thread_local unsigned thread_index = threads_count++;
+
+double pool_option(const conn_info& ci, const char* name, const char* def)
+{
+    double res = -1.0;
+    try
+    {
+        res = boost::lexical_cast<double>(ci.get(name, def));
+    }
+    catch(const boost::bad_lexical_cast&)
+    {
+    }
+
+    if (!(res >= 0.0))
+        throw edba_error(std::string("edba::session_pool: ") + name + " should be non-negative number");
+
+    return res;
+}
+
+bool pool_flag(const conn_info& ci, const char* name)
+{
+    const std::locale& loc = std::locale::classic();
+    string_ref value = ci.get(name, "off");
+
+    if (boost::algorithm::iequals(value, "on", loc))
+        return true;
+    else if (!boost::algorithm::iequals(value, "off", loc))
+        throw edba_error(std::string("edba::session_pool: ") + name + " should be either 'on' or 'off'");
+
+    return false;
+}
+
+}
+
+struct session_pool::pooled_connection
+{
+    explicit pooled_connection(const backend::connection_ptr& conn)
+      : conn(conn)
+      , returned(backend::stat_clock::now())
+      , priority_class(0)
+      , created(backend::stat_clock::now())
+      , uses(0)
+      , retire_at(0)
+      , max_uses(0)
+      , proxy(0)
+    {
+        std::fill(affinity, affinity + affinity_keys, 0);
+    }
+
+    bool serves(std::size_t key) const
+    {
+        return std::find(affinity, affinity + affinity_keys, key) != affinity + affinity_keys;
+    }
+
+    void remember(std::size_t key)
+    {
+        if (!serves(key))
+        {
+            std::copy_backward(affinity, affinity + affinity_keys - 1, affinity + affinity_keys);
+            affinity[0] = key;
+        }
+    }
+
+    boost::uint64_t affinity_mask() const
+    {
+        boost::uint64_t res = 0;
+        for (int i = 0; i < affinity_keys; ++i)
+            res |= affinity[i] ? affinity_bit(affinity[i]) : 0;
+
+        return res;
+    }
+
+    ~pooled_connection();
+
+    backend::connection_ptr conn;
+    backend::stat_clock::time_point returned;      // Time when connection became idle
+    int priority_class;                            // Class of open call that took connection
+    backend::stat_clock::time_point created;
+    unsigned long long uses;                       // Number of times connection was returned to pool
+    backend::stat_clock::time_point retire_at;     // Time when connection is retired, 0 if lifetime is unlimited
+    unsigned long long max_uses;                   // Uses after which connection is retired, 0 if unlimited
+    connection_proxy* proxy;                       // Given to sessions by every open call, not deleted when session is closed
+    std::size_t affinity[affinity_keys];           // Affinity keys of recent open calls, most recent first
+};
+
+// Open call waiting for free connection, served by thread that frees connection or place for new one
+struct session_pool::pool_waiter
+{
+    pool_waiter() : served(false), conn(0) {}
+
+    boost::condition_variable cv;
+    bool served;
+    pooled_connection* conn;                  // Given connection, null if place for new connection is reserved
+};
+
+struct session_pool::open_class
+{
+    open_class() : priority(0), reserved(0), max_waiters(std::numeric_limits<int>::max()), in_use(0) {}
+
+    std::string name;
+    int priority;
+    int reserved;                             // Connections that can be taken only by this class
+    int max_waiters;
+    int in_use;                               // Connections taken by class, including ones being created
+    std::list<pool_waiter*> waiters;          // Open calls of class waiting for free connection, first is served first
+};
+
+// Copy of fields of idle connection that other threads may read, connection itself may be taken and closed
+// at any moment. Fields are written after connection is stored to slot, so reader may see values of previous
+// connection and should check connection after taking it.
+struct session_pool::slot_state
+{
+    slot_state() : keys(0), returned(0), retire_at(0) {}
+
+    boost::atomic<boost::uint64_t> keys;      // Mask of affinity keys
+    boost::atomic<backend::stat_clock::time_point> returned;
+    boost::atomic<backend::stat_clock::time_point> retire_at;
+};
+
+struct session_pool::idle_shard
+{
+    idle_shard() : conn(0), borrows(0), returns(0), total_sec(0.0) {}
+
+    idle_slot conn;                           // Free connection returned by threads of shard
+    slot_state state;                         // Copy of fields of connection in slot
+    boost::atomic<unsigned long long> borrows;
+    boost::atomic<unsigned long long> returns;
+
+    mutex guard;                              // Guard counters of returned sessions
+    double total_sec;
+    statement_cache_stat cache;
+
+    char padding[64];                         // Keep shards used by different threads on different cache lines
+};
+
 struct session_pool::connection_proxy : backend::connection_iface
 {
-    connection_proxy(session_pool& pool, const backend::connection_ptr& conn)
+    connection_proxy(session_pool& pool, pooled_connection* pc)
       : pool_(pool)
-      , conn_(conn)
-      , exec_time_on_init_(conn->total_execution_time())
+      , pc_(pc)
+      , conn_(pc->conn)
+      , exec_time_on_init_(0.0)
+    {
+    }
+
+    // Remember counters of connection before it is given to session
+    void attach()
     {
+        exec_time_on_init_ = conn_->total_execution_time();
+        cache_stat_on_init_ = conn_->cache_stat();
     }
 
-    ~connection_proxy()
+    // Last session that uses proxy is closed, proxy stays with connection for next open call
+    virtual void destroy()
     {
-        mutex::scoped_lock g(pool_.pool_guard_);
-        pool_.total_sec_ += conn_->total_execution_time() - exec_time_on_init_;
-        pool_.pool_.push_back(conn_);
-        pool_.pool_max_cv_.notify_one();
+        if (pool_.sm_)
+        {
+            try
+            {
+                pool_.sm_->session_closed(session_pool::connection_id(conn_));
+            }
+            catch(...)
+            {
+                // Connection should be returned to pool anyway
+            }
+        }
+
+        pool_.release(pc_, conn_->total_execution_time() - exec_time_on_init_, conn_->cache_stat() - cache_stat_on_init_);
     }
 
     virtual backend::statement_ptr prepare_statement(const string_ref& q)
@@ -25,6 +208,11 @@ struct session_pool::connection_proxy : backend::connection_iface
         return conn_->prepare_statement(q);
     }
 
+    virtual backend::statement_ptr prepare_statement(const sql_literal& q)
+    {
+        return conn_->prepare_statement(q);
+    }
+
     virtual backend::statement_ptr create_statement(const string_ref& q)
     {
         return conn_->create_statement(q);
@@ -45,6 +233,16 @@ struct session_pool::connection_proxy : backend::connection_iface
         return conn_->get_specific();
     }
 
+    virtual void set_query_templates(const boost::shared_ptr<backend::query_template_cache>& templates)
+    {
+        return conn_->set_query_templates(templates);
+    }
+
+    virtual void set_latency_registry(const boost::shared_ptr<backend::latency_registry>& latencies)
+    {
+        return conn_->set_latency_registry(latencies);
+    }
+
     virtual void begin()
     {
         return conn_->begin();
@@ -60,6 +258,11 @@ struct session_pool::connection_proxy : backend::connection_iface
         return conn_->rollback();
     }
 
+    virtual bool ping()
+    {
+        return conn_->ping();
+    }
+
     virtual std::string escape(const string_ref& str)
     {
         return conn_->escape(str);
@@ -90,29 +293,153 @@ struct session_pool::connection_proxy : backend::connection_iface
         return conn_->total_execution_time();
     }
 
+    virtual statement_cache_stat cache_stat() const
+    {
+        return conn_->cache_stat();
+    }
+
+    virtual std::vector<query_latency> query_latencies() const
+    {
+        return conn_->query_latencies();
+    }
+
     virtual const conn_info& connection_info() const
     {
         return conn_->connection_info();
     }
 
+
 private:
     session_pool& pool_;
-    backend::connection_ptr conn_;
+    pooled_connection* pc_;
+    const backend::connection_ptr& conn_;
     double exec_time_on_init_;
+    statement_cache_stat cache_stat_on_init_;
 };
 
+session_pool::pooled_connection::~pooled_connection()
+{
+    delete proxy;
+}
+
 session_pool::session_pool(const char* conn_string, int max_pool_size, session_monitor* sm)
-    : session_pool(conn_info(conn_string), max_pool_size, sm)
+    : session_pool(conn_info(conn_string), max_pool_size, sm, conn_init_callback())
 {
 }
 
 session_pool::session_pool(const conn_info& ci, int max_pool_size, session_monitor* sm)
+    : session_pool(ci, max_pool_size, sm, conn_init_callback())
+{
+}
+
+session_pool::session_pool(const char* conn_string, int max_pool_size, session_monitor* sm, const conn_init_callback& on_connect, const std::vector<std::string>& prepare_queries)
+    : session_pool(conn_info(conn_string), max_pool_size, sm, on_connect, prepare_queries)
+{
+}
+
+session_pool::session_pool(const conn_info& ci, int max_pool_size, session_monitor* sm, const conn_init_callback& on_connect, const std::vector<std::string>& prepare_queries)
     : conn_info_(ci)
+    , max_pool_size_(max_pool_size)
     , conn_left_unopened_(max_pool_size)
     , sm_(sm)
     , total_sec_(0.0)
+    , borrows_(0)
+    , returns_(0)
+    , waits_(0)
+    , wait_sec_(0.0)
+    , closed_(0)
+    , broken_(0)
+    , recycled_(0)
+    , templates_(new backend::query_template_cache)
+    , latencies_(backend::create_latency_registry(ci))
+    , waiters_(0)
+    , timeouts_(0)
+    , rejected_(0)
+    , prioritized_(false)
+    , classes_count_(1)
+    , affinity_hits_(0)
+    , affinity_misses_(0)
+    , shards_count_(0)
+    , min_idle_(0)
+    , idle_timeout_(0.0)
+    , validate_(false)
+    , validate_idle_(0.0)
+    , max_lifetime_(0.0)
+    , max_uses_(0)
+    , recycle_jitter_(0.0)
+    , random_(static_cast<boost::uint32_t>(std::time(0)))
+    , stopping_(false)
 {
-    pool_.reserve(max_pool_size);
+    conn_init_callback_ = on_connect;
+    warm_up_queries_ = prepare_queries;
+
+    if (pool_flag(ci, "@query_stats"))
+    {
+        // Aggregator sees only executions reported to monitor, sampled counts would be silently scaled down
+        if (pool_option(ci, "@monitor_sample_rate", "1") != 1.0 || pool_option(ci, "@monitor_slow_ms", "0") != 0.0)
+            throw edba_error("edba::session_pool: @query_stats can`t be combined with @monitor_sample_rate or @monitor_slow_ms");
+
+        query_stats_.reset(new query_stats(sm));
+        sm_ = query_stats_.get();
+    }
+
+    shards_count_ = static_cast<int>(pool_option(ci, "@pool_shards", "0"));
+    min_idle_ = (std::min)(static_cast<int>(pool_option(ci, "@pool_min_idle", "0")), max_pool_size);
+    idle_timeout_ = pool_option(ci, "@pool_idle_timeout", "0");
+
+    validate_idle_ = pool_option(ci, "@pool_validate_idle", "0");
+    max_lifetime_ = pool_option(ci, "@pool_max_lifetime", "0");
+    max_uses_ = static_cast<unsigned long long>(pool_option(ci, "@pool_max_uses", "0"));
+    recycle_jitter_ = (std::min)(pool_option(ci, "@pool_recycle_jitter", "0.1"), 1.0);
+
+    bool prefill_on_start = pool_flag(ci, "@pool_prefill");
+    validate_ = pool_flag(ci, "@pool_validate");
+
+    open_class default_class;
+    default_class.name = "default";
+    classes_.push_back(default_class);
+    classes_order_.push_back(0);
+
+    if (shards_count_ > 0 && max_pool_size > 0)
+    {
+        shards_.reset(new idle_shard[shards_count_]);
+        overflow_.reset(new idle_slot[max_pool_size]);
+        overflow_state_.reset(new slot_state[max_pool_size]);
+        for (int i = 0; i < max_pool_size; ++i)
+            overflow_[i].store(0, boost::memory_order_relaxed);
+    }
+    else
+        pool_.reserve(max_pool_size);
+
+    if (prefill_on_start)
+    {
+        mutex::scoped_lock g(pool_guard_);
+        start_maintainer();
+    }
+}
+
+session_pool::~session_pool()
+{
+    {
+        mutex::scoped_lock g(pool_guard_);
+        stopping_ = true;
+        maintainer_cv_.notify_one();
+    }
+
+    if (maintainer_)
+        maintainer_->join();
+
+    BOOST_FOREACH(pooled_connection* pc, pool_)
+        delete pc;
+
+    BOOST_FOREACH(pooled_connection* pc, retired_)
+        delete pc;
+
+    for (int i = 0; shards_ && i < shards_count_; ++i)
+        delete shards_[i].conn.exchange(0);
+
+    for (int i = 0; shards_ && i < max_pool_size_; ++i)
+        delete overflow_[i].exchange(0);
 }
 
 void session_pool::invoke_on_connect(const conn_init_callback& callback)
@@ -121,77 +448,899 @@ void session_pool::invoke_on_connect(const conn_init_callback& callback)
     conn_init_callback_ = callback;
 }
 
+void session_pool::prepare_on_connect(const std::vector<std::string>& queries)
+{
+    mutex::scoped_lock g(pool_guard_);
+    warm_up_queries_ = queries;
+}
+
+void session_pool::prefill()
+{
+    {
+        mutex::scoped_lock g(pool_guard_);
+        start_maintainer();
+    }
+
+    fill_idle(true);
+}
+
 session session_pool::open()
+{
+    return open_until(0, 0, 0);
+}
+
+session session_pool::open(boost::chrono::steady_clock::duration timeout)
+{
+    boost::chrono::steady_clock::time_point deadline = boost::chrono::steady_clock::now() + timeout;
+    return open_until(0, 0, &deadline);
+}
+
+session session_pool::open(boost::chrono::steady_clock::time_point deadline)
+{
+    return open_until(0, 0, &deadline);
+}
+
+session session_pool::open(int priority_class)
+{
+    return open_until(priority_class, 0, 0);
+}
+
+session session_pool::open(int priority_class, boost::chrono::steady_clock::duration timeout)
+{
+    boost::chrono::steady_clock::time_point deadline = boost::chrono::steady_clock::now() + timeout;
+    return open_until(priority_class, 0, &deadline);
+}
+
+session session_pool::open(int priority_class, boost::chrono::steady_clock::time_point deadline)
+{
+    return open_until(priority_class, 0, &deadline);
+}
+
+session session_pool::open_with_affinity(std::size_t affinity)
+{
+    return open_until(0, affinity, 0);
+}
+
+session session_pool::open_until(int priority_class, std::size_t affinity, const boost::chrono::steady_clock::time_point* deadline)
+{
+    check_class(priority_class);
+
+    double wait_time = 0.0;
+
+    pooled_connection* conn = checkout(priority_class, affinity, true, deadline, wait_time);
+    while (!alive(conn))
+        conn = checkout(priority_class, affinity, true, deadline, wait_time);
+
+    return opened_session(conn, affinity, wait_time);
+}
+
+bool session_pool::try_open(session& sess)
+{
+    return try_open_with(sess, 0, 0);
+}
+
+bool session_pool::try_open(session& sess, int priority_class)
+{
+    return try_open_with(sess, priority_class, 0);
+}
+
+bool session_pool::try_open_with_affinity(session& sess, std::size_t affinity)
+{
+    return try_open_with(sess, 0, affinity);
+}
+
+bool session_pool::try_open_with(session& sess, int priority_class, std::size_t affinity)
+{
+    check_class(priority_class);
+
+    double wait_time = 0.0;
+
+    pooled_connection* conn = checkout(priority_class, affinity, false, 0, wait_time);
+    while (conn && !alive(conn))
+        conn = checkout(priority_class, affinity, false, 0, wait_time);
+
+    if (!conn)
+        return false;
+
+    sess = opened_session(conn, affinity, wait_time);
+    return true;
+}
+
+int session_pool::define_class(const std::string& name, int priority, int reserved, int max_waiters)
 {
     mutex::scoped_lock g(pool_guard_);
 
-    if (!pool_.empty())  // take connection from pool
+    int total_reserved = reserved;
+    BOOST_FOREACH(const open_class& c, classes_)
+        total_reserved += c.reserved;
+
+    if (reserved < 0 || total_reserved > max_pool_size_)
+        throw edba_error("edba::session_pool: connections reserved for priority classes exceed pool size");
+
+    // Sessions taken before classes were defined are not counted in their class and would corrupt counts on return
+    if (busy())
+        throw edba_error("edba::session_pool: priority classes can`t be defined while sessions are taken from pool");
+
+    open_class c;
+    c.name = name;
+    c.priority = priority;
+    c.reserved = reserved;
+    c.max_waiters = max_waiters < 0 ? std::numeric_limits<int>::max() : max_waiters;
+    classes_.push_back(c);
+
+    // Classes with higher priority are served first, stable sort keeps definition order for equal priorities
+    classes_order_.push_back(static_cast<int>(classes_.size()) - 1);
+    std::stable_sort(classes_order_.begin(), classes_order_.end(), boost::bind(&session_pool::higher_priority, this, boost::placeholders::_1, boost::placeholders::_2));
+
+    classes_count_.store(static_cast<int>(classes_.size()));
+    prioritized_.store(true);
+    return static_cast<int>(classes_.size()) - 1;
+}
+
+void session_pool::check_class(int priority_class)
+{
+    // Classes are never removed, so open calls check index without pool lock
+    if (priority_class != 0 && (priority_class < 0 || priority_class >= classes_count_.load(boost::memory_order_acquire)))
+        throw edba_error("edba::session_pool: unknown priority class " + boost::lexical_cast<std::string>(priority_class));
+}
+
+bool session_pool::higher_priority(int c1, int c2) const
+{
+    return classes_[c1].priority > classes_[c2].priority;
+}
+
+bool session_pool::admissible(int priority_class)
+{
+    if (!prioritized_)
+        return true;
+
+    // Connections reserved for other classes and not used by them can`t be taken
+    int reserved_for_others = 0;
+    for (int i = 0; i < static_cast<int>(classes_.size()); ++i)
     {
-        session sess(create_proxy(pool_.back()));
-        pool_.pop_back();
-        return sess;
+        if (i != priority_class && classes_[i].reserved > classes_[i].in_use)
+            reserved_for_others += classes_[i].reserved - classes_[i].in_use;
     }
-    else if (pool_.empty() && conn_left_unopened_) // we can create new connection
+
+    int available = conn_left_unopened_ + (shards_ ? idle_slots_count() : static_cast<int>(pool_.size()));
+    return available > reserved_for_others;
+}
+
+bool session_pool::waiting_ahead(int priority_class)
+{
+    // Waiters that can`t be admitted themselves don`t block other classes, e.g. from their reserved connections
+    for (int i = 0; i < static_cast<int>(classes_.size()); ++i)
     {
-        backend::connection_ptr conn = driver_manager::create_conn(conn_info_, sm_);
+        const open_class& c = classes_[i];
+        if (c.priority >= classes_[priority_class].priority && !c.waiters.empty() && admissible(i))
+            return true;
+    }
+
+    return false;
+}
+
+session_pool::pooled_connection* session_pool::checkout(int priority_class, std::size_t affinity, bool wait, const boost::chrono::steady_clock::time_point* deadline, double& wait_time)
+{
+    pooled_connection* conn = 0;
+    if (shards_ && !prioritized_ && take_idle(conn, affinity))
+        return conn;
+
+    {
+        mutex::scoped_lock g(pool_guard_);
+        start_maintainer();
+
+        open_class& cls = classes_[priority_class];
+        bool admitted = !prioritized_ || (!waiting_ahead(priority_class) && admissible(priority_class));
+
+        if (admitted && pop_idle(conn, affinity))  // take connection from pool
+            ;
+        else if (admitted && conn_left_unopened_) // reserve place for new connection, it is created without lock
+            --conn_left_unopened_;
+        else if (!wait)
+            return 0;
+        else if (static_cast<int>(cls.waiters.size()) >= cls.max_waiters)
+        {
+            ++rejected_;
+            throw pool_overloaded(cls.name);
+        }
+        else // we must wait until someone will free connection for us
+        {
+            backend::stat_clock::time_point start = backend::stat_clock::now();
+
+            pool_waiter w;
+            std::list<pool_waiter*>::iterator pos = cls.waiters.insert(cls.waiters.end(), &w);
+            ++waiters_;
+
+            // Connection may have been returned to sharded pool before waiter was counted
+            if (shards_)
+                serve_waiters();
+
+            bool expired = false;
+            try
+            {
+                while (!w.served && !expired)
+                {
+                    if (deadline)
+                        expired = boost::cv_status::timeout == w.cv.wait_until(g, *deadline);
+                    else
+                        w.cv.wait(g);
+                }
+            }
+            catch(...)
+            {
+                // Thread is interrupted, give back what was given to it
+                --waiters_;
+                if (!w.served)
+                    cls.waiters.erase(pos);
+                else
+                {
+                    if (prioritized_)
+                        --cls.in_use;
+
+                    if (w.conn && shards_)
+                        put_idle(w.conn);
+                    else if (w.conn)
+                        pool_.push_back(w.conn);
+                    else
+                        ++conn_left_unopened_;
+                }
 
-        if (conn_init_callback_)
-            // Don`t use proxy wrapper over connection because in case of exception in conn_init_callback_
-            // proxy wrapper will try to lock non-recursive pool mutex, and we will get deadlock.
-            conn_init_callback_(session(conn));
+                serve_waiters();
+                throw;
+            }
 
-        // Now we can construct session using proxy connection
-        session sess(create_proxy(conn));
-        --conn_left_unopened_;
+            --waiters_;
+            if (!w.served)
+                cls.waiters.erase(pos);
 
-        return sess;
+            double waited = backend::stat_clock::seconds_since(start);
+            wait_time += waited;
+            ++waits_;
+            wait_sec_ += waited;
+            wait_histogram_.record(waited);
+
+            if (!w.served)
+            {
+                ++timeouts_;
+                throw pool_timeout();
+            }
+
+            conn = w.conn;
+            admitted = false; // counted in class by serve_waiters
+        }
+
+        if (admitted && prioritized_)
+            ++cls.in_use;
     }
-    else // we must wait until someone will free connection for us
+
+    if (!conn)
+        conn = create_reserved(priority_class);
+
+    conn->priority_class = priority_class;
+    return conn;
+}
+
+void session_pool::serve_waiters()
+{
+    BOOST_FOREACH(int i, classes_order_)
     {
-        pool_max_cv_.wait(g, !boost::bind(&pool_type::empty, &pool_));
-        assert(!pool_.empty() && "pool_ is not empty");
+        open_class& cls = classes_[i];
+        while (!cls.waiters.empty() && admissible(i))
+        {
+            pool_waiter& w = *cls.waiters.front();
+
+            if (pop_idle(w.conn, 0))
+                ;
+            else if (conn_left_unopened_)
+                --conn_left_unopened_;
+            else
+                return;
+
+            if (prioritized_)
+                ++cls.in_use;
 
-        session sess(create_proxy(pool_.back()));
-        pool_.pop_back();
-        return sess;
+            w.served = true;
+            cls.waiters.pop_front();
+            w.cv.notify_one();
+        }
     }
 }
 
-bool session_pool::try_open(session& sess)
+bool session_pool::alive(pooled_connection* conn)
 {
-    mutex::scoped_lock g(pool_guard_);
+    if (!validate_ || backend::stat_clock::seconds_since(conn->returned) < validate_idle_ || conn->conn->ping())
+        return true;
+
+    {
+        mutex::scoped_lock g(pool_guard_);
+        ++broken_;
+        if (prioritized_)
+            --classes_[conn->priority_class].in_use;
+    }
+
+    close(conn);
+    return false;
+}
+
+session session_pool::opened_session(pooled_connection* conn, std::size_t affinity, double wait_time)
+{
+    if (shards_)
+        home_shard().borrows.fetch_add(1, boost::memory_order_relaxed);
+    else
+        borrows_.fetch_add(1, boost::memory_order_relaxed);
+
+    if (affinity)
+    {
+        (conn->serves(affinity) ? affinity_hits_ : affinity_misses_).fetch_add(1, boost::memory_order_relaxed);
+        conn->remember(affinity);
+    }
+
+    // Proxy returns connection to pool even if monitor throws
+    conn->proxy->attach();
+    session sess(backend::connection_ptr(conn->proxy));
+
+    if (sm_)
+        sm_->session_opened(connection_id(conn->conn), wait_time);
+
+    return sess;
+}
 
-    if (!pool_.empty())  // take connection from pool
+std::size_t session_pool::connection_id(const backend::connection_ptr& conn)
+{
+    return reinterpret_cast<std::size_t>(conn.get());
+}
+
+bool session_pool::pop_idle(pooled_connection*& conn, std::size_t affinity)
+{
+    if (shards_)
+        return take_idle(conn, affinity);
+
+    if (pool_.empty())
+        return false;
+
+    // Prefer the most recently returned connection that served the same affinity key
+    pool_type::iterator found = pool_.end() - 1;
+    for (pool_type::iterator it = pool_.end(); affinity && it != pool_.begin(); )
+    {
+        if ((*--it)->serves(affinity))
+        {
+            found = it;
+            break;
+        }
+    }
+
+    conn = *found;
+    pool_.erase(found);
+
+    // Ask maintainer to open more connections
+    if (static_cast<int>(pool_.size()) < min_idle_)
+        maintainer_cv_.notify_one();
+
+    return true;
+}
+
+bool session_pool::take_idle(pooled_connection*& conn, std::size_t affinity)
+{
+    // Idle connection may be taken and closed by other thread at any moment, so affinity keys of slots are checked
+    // instead of keys of connections. Connection taken by mismatched key is still good for caller.
+    boost::uint64_t key_bit = affinity_bit(affinity);
+    for (int i = 0; affinity && i < shards_count_ + max_pool_size_; ++i)
     {
-        sess = session(create_proxy(pool_.back()));
-        pool_.pop_back();
+        idle_slot& slot = i < shards_count_ ? shards_[i].conn : overflow_[i - shards_count_];
+        slot_state& state = i < shards_count_ ? shards_[i].state : overflow_state_[i - shards_count_];
+        conn = (state.keys.load(boost::memory_order_relaxed) & key_bit) && slot.load() ? slot.exchange(0) : 0;
+        if (conn)
+            return true;
     }
-    else if (pool_.empty() && conn_left_unopened_) // we can create new connection
+
+    idle_shard& home = home_shard();
+    conn = home.conn.load() ? home.conn.exchange(0) : 0;
+
+    // Search overflow slots and then slots of other shards
+    for (int i = 0; !conn && i < max_pool_size_; ++i)
     {
-        backend::connection_ptr conn = driver_manager::create_conn(conn_info_, sm_);
-        if (conn_init_callback_)
-            conn_init_callback_(session(conn));
+        idle_slot& slot = overflow_[(thread_index + i) % max_pool_size_];
+        conn = slot.load() ? slot.exchange(0) : 0;
+    }
 
-        session tmp(create_proxy(conn));
-        --conn_left_unopened_;
+    for (int i = 1; !conn && i < shards_count_; ++i)
+    {
+        idle_slot& slot = shards_[(thread_index + i) % shards_count_].conn;
+        conn = slot.load() ? slot.exchange(0) : 0;
+    }
+
+    return conn != 0;
+}
 
-        sess = tmp;
+void session_pool::put_idle(pooled_connection* conn)
+{
+    idle_shard& home = home_shard();
+    if (fill_slot(home.conn, home.state, conn))
+        return;
+
+    // There are at most max_pool_size_ free connections, so free overflow slot is always found
+    for (int i = 0; ; ++i)
+    {
+        int idx = (thread_index + i) % max_pool_size_;
+        if (fill_slot(overflow_[idx], overflow_state_[idx], conn))
+            return;
     }
-    else // we must wait until someone will free connection for us
+}
+
+bool session_pool::fill_slot(idle_slot& slot, slot_state& state, pooled_connection* conn)
+{
+    // Fields are copied before connection becomes visible to other threads, they may take it right after exchange
+    boost::uint64_t keys = conn->affinity_mask();
+    backend::stat_clock::time_point returned = conn->returned;
+    backend::stat_clock::time_point retire_at = conn->retire_at;
+
+    pooled_connection* expected = 0;
+    if (!slot.compare_exchange_strong(expected, conn))
         return false;
 
+    state.keys.store(keys, boost::memory_order_relaxed);
+    state.returned.store(returned, boost::memory_order_relaxed);
+    state.retire_at.store(retire_at, boost::memory_order_relaxed);
     return true;
 }
 
+void session_pool::store_idle(pooled_connection* conn)
+{
+    if (!shards_)
+    {
+        mutex::scoped_lock g(pool_guard_);
+        pool_.push_back(conn);
+        serve_waiters();
+        return;
+    }
+
+    put_idle(conn);
+
+    // Waiter counts itself before it checks free connections, so either it finds this connection or it is served
+    if (waiters_.load())
+    {
+        mutex::scoped_lock g(pool_guard_);
+        serve_waiters();
+    }
+}
+
+void session_pool::release(pooled_connection* conn, double exec_time, const statement_cache_stat& cache)
+{
+    conn->returned = backend::stat_clock::now();
+    ++conn->uses;
+    bool recycle = recycle_due(conn);
+
+    if (!shards_)
+    {
+        mutex::scoped_lock g(pool_guard_);
+        returns_.fetch_add(1, boost::memory_order_relaxed);
+        total_sec_ += exec_time;
+        cache_stat_ += cache;
+        if (prioritized_)
+            --classes_[conn->priority_class].in_use;
+
+        if (recycle)
+            retire(conn);
+        else
+        {
+            pool_.push_back(conn);
+            serve_waiters();
+        }
+        return;
+    }
+
+    {
+        idle_shard& home = home_shard();
+        mutex::scoped_lock g(home.guard);
+        home.returns.fetch_add(1, boost::memory_order_relaxed);
+        home.total_sec += exec_time;
+        home.cache += cache;
+    }
+
+    if (prioritized_ || recycle)
+    {
+        mutex::scoped_lock g(pool_guard_);
+        if (prioritized_)
+            --classes_[conn->priority_class].in_use;
+
+        if (recycle)
+            retire(conn);
+        else
+        {
+            put_idle(conn);
+            serve_waiters();
+        }
+        return;
+    }
+
+    store_idle(conn);
+}
+
+session_pool::idle_shard& session_pool::home_shard()
+{
+    return shards_[thread_index % shards_count_];
+}
+
+int session_pool::busy() const
+{
+    // Returns are read before borrows, so session borrowed and returned meanwhile can`t make result negative
+    unsigned long long returns = returns_.load(boost::memory_order_acquire);
+    for (int i = 0; shards_ && i < shards_count_; ++i)
+        returns += shards_[i].returns.load(boost::memory_order_acquire);
+
+    unsigned long long borrows = borrows_.load(boost::memory_order_acquire);
+    for (int i = 0; shards_ && i < shards_count_; ++i)
+        borrows += shards_[i].borrows.load(boost::memory_order_acquire);
+
+    return static_cast<int>(borrows - returns);
+}
+
+void session_pool::collect_shards(double& total_sec, statement_cache_stat& cache, unsigned long long& borrows)
+{
+    for (int i = 0; shards_ && i < shards_count_; ++i)
+    {
+        mutex::scoped_lock g(shards_[i].guard);
+        total_sec += shards_[i].total_sec;
+        cache += shards_[i].cache;
+        borrows += shards_[i].borrows.load(boost::memory_order_relaxed);
+    }
+}
+
+int session_pool::idle_slots_count()
+{
+    int res = 0;
+
+    for (int i = 0; shards_ && i < shards_count_; ++i)
+        res += shards_[i].conn.load() ? 1 : 0;
+
+    for (int i = 0; shards_ && i < max_pool_size_; ++i)
+        res += overflow_[i].load() ? 1 : 0;
+
+    return res;
+}
+
+void session_pool::start_maintainer()
+{
+    if (!maintainer_ && !stopping_ && (min_idle_ > 0 || idle_timeout_ > 0 || max_lifetime_ > 0 || max_uses_ > 0))
+        maintainer_.reset(new boost::thread(boost::bind(&session_pool::maintain, this)));
+}
+
+void session_pool::maintain()
+{
+    // Check idle connections often enough to close them soon after idle timeout or lifetime is over
+    double interval = 1.0;
+    if (idle_timeout_ > 0)
+        interval = (std::min)(idle_timeout_ / 2, interval);
+    if (max_lifetime_ > 0)
+        interval = (std::min)(max_lifetime_ * (1.0 - recycle_jitter_) / 2, interval);
+    boost::chrono::milliseconds interval_ms(static_cast<long long>(interval * 1000) + 1);
+
+    mutex::scoped_lock g(pool_guard_);
+    while (!stopping_)
+    {
+        g.unlock();
+        try
+        {
+            close_expired();
+            replace_retired();
+            fill_idle(false);
+        }
+        catch(...)
+        {
+            // Failed connections are given back to pool, maintainer will try again
+        }
+        g.lock();
+
+        if (!stopping_ && retired_.empty())
+            maintainer_cv_.wait_for(g, interval_ms);
+    }
+}
+
+void session_pool::close_expired()
+{
+    if (idle_timeout_ <= 0 && max_lifetime_ <= 0)
+        return;
+
+    boost::mutex::scoped_lock m(maintain_guard_);
+    std::vector<pooled_connection*> expired;
+
+    if (!shards_)
+    {
+        mutex::scoped_lock g(pool_guard_);
+
+        // Connections are taken from back of pool, so front ones are idle for longest time
+        size_t n = 0;
+        while (idle_timeout_ > 0
+            && n < pool_.size()
+            && static_cast<int>(pool_.size() - n) > min_idle_
+            && backend::stat_clock::seconds_since(pool_[n]->returned) >= idle_timeout_)
+        {
+            ++n;
+        }
+
+        expired.assign(pool_.begin(), pool_.begin() + n);
+        pool_.erase(pool_.begin(), pool_.begin() + n);
+
+        for (size_t i = pool_.size(); max_lifetime_ > 0 && i-- > 0; )
+        {
+            if (recycle_due(pool_[i]))
+            {
+                retire(pool_[i]);
+                pool_.erase(pool_.begin() + i);
+            }
+        }
+    }
+    else
+    {
+        // Take out only connections that expired according to state of their slots, keeping at least min_idle_
+        // of them. Other connections stay in their slots, so open calls don`t miss them and threads keep their slots.
+        std::vector<pooled_connection*> retired;
+        bool restored = false;
+        int idle = idle_slots_count();
+        for (int i = 0; i < shards_count_ + max_pool_size_; ++i)
+        {
+            idle_slot& slot = i < shards_count_ ? shards_[i].conn : overflow_[i - shards_count_];
+            slot_state& state = i < shards_count_ ? shards_[i].state : overflow_state_[i - shards_count_];
+
+            backend::stat_clock::time_point now = backend::stat_clock::now();
+            backend::stat_clock::time_point retire_at = state.retire_at.load(boost::memory_order_relaxed);
+            bool idle_expired = idle_timeout_ > 0 && idle > min_idle_
+                && backend::stat_clock::seconds(state.returned.load(boost::memory_order_relaxed), now) >= idle_timeout_;
+
+            if (!idle_expired && !(retire_at && now >= retire_at))
+                continue;
+
+            pooled_connection* conn = slot.load() ? slot.exchange(0) : 0;
+            if (!conn)
+                continue;
+
+            // State may belong to connection that was in slot before
+            if (idle_timeout_ > 0 && idle > min_idle_ && backend::stat_clock::seconds_since(conn->returned) >= idle_timeout_)
+            {
+                expired.push_back(conn);
+                --idle;
+            }
+            else if (recycle_due(conn))
+                retired.push_back(conn);
+            else
+            {
+                if (!fill_slot(slot, state, conn))
+                    put_idle(conn);
+                restored = true;
+            }
+        }
+
+        mutex::scoped_lock g(pool_guard_);
+        BOOST_FOREACH(pooled_connection* conn, retired)
+            retire(conn);
+
+        // Waiter may have missed connection while it was out of slot
+        if (restored)
+            serve_waiters();
+    }
+
+    BOOST_FOREACH(pooled_connection* conn, expired)
+        close(conn);
+}
+
+bool session_pool::recycle_due(const pooled_connection* conn) const
+{
+    return (conn->retire_at && backend::stat_clock::now() >= conn->retire_at)
+        || (conn->max_uses && conn->uses >= conn->max_uses);
+}
+
+void session_pool::retire(pooled_connection* conn)
+{
+    // Called under pool_guard_, place of connection is not given back until replacement is opened
+    retired_.push_back(conn);
+    ++recycled_;
+    start_maintainer();
+    maintainer_cv_.notify_one();
+}
+
+void session_pool::replace_retired()
+{
+    std::vector<pooled_connection*> retired;
+    {
+        mutex::scoped_lock g(pool_guard_);
+        retired.swap(retired_);
+    }
+
+    BOOST_FOREACH(pooled_connection* conn, retired)
+    {
+        delete conn;
+
+        try
+        {
+            store_idle(create_reserved(-1));
+        }
+        catch(...)
+        {
+            // Place is given back to pool, connection will be opened by open call
+        }
+    }
+}
+
+void session_pool::fill_idle(bool rethrow)
+{
+    boost::mutex::scoped_lock m(maintain_guard_);
+
+    int count = 0;
+    {
+        mutex::scoped_lock g(pool_guard_);
+        int idle = shards_ ? idle_slots_count() : static_cast<int>(pool_.size());
+        count = (std::min)(min_idle_ - idle, conn_left_unopened_);
+        if (count <= 0)
+            return;
+
+        conn_left_unopened_ -= count;
+    }
+
+    // Open connections in parallel, each of them has reserved place
+    std::vector<std::exception_ptr> errors(count);
+    boost::thread_group tg;
+    for (int i = 1; i < count; ++i)
+        tg.create_thread(boost::bind(&session_pool::open_idle, this, boost::ref(errors[i])));
+    open_idle(errors[0]);
+    tg.join_all();
+
+    for (int i = 0; rethrow && i < count; ++i)
+    {
+        if (errors[i])
+            std::rethrow_exception(errors[i]);
+    }
+}
+
+void session_pool::open_idle(std::exception_ptr& error)
+{
+    try
+    {
+        store_idle(create_reserved(-1));
+    }
+    catch(...)
+    {
+        error = std::current_exception();
+    }
+}
+
+void session_pool::close(pooled_connection* conn)
+{
+    delete conn;
+
+    mutex::scoped_lock g(pool_guard_);
+    ++conn_left_unopened_;
+    ++closed_;
+    serve_waiters();
+}
+
 double session_pool::total_execution_time()
 {
+    return stat().execution_time;
+}
+
+statement_cache_stat session_pool::cache_stat()
+{
+    return stat().cache;
+}
+
+std::vector<query_latency> session_pool::query_latencies()
+{
+    return latencies_ ? latencies_->report() : std::vector<query_latency>();
+}
+
+std::vector<query_fingerprint_stat> session_pool::top_queries(size_t n)
+{
+    return query_stats_ ? query_stats_->top(n) : std::vector<query_fingerprint_stat>();
+}
+
+session_pool_stat session_pool::stat()
+{
+    session_pool_stat res;
+
+    collect_shards(res.execution_time, res.cache, res.borrows);
+    res.idle = idle_slots_count();
+
     mutex::scoped_lock g(pool_guard_);
-    return total_sec_;
+    res.max_size = max_pool_size_;
+    res.open = max_pool_size_ - conn_left_unopened_;
+    res.idle += static_cast<int>(pool_.size());
+    res.borrows += borrows_.load(boost::memory_order_relaxed);
+    res.waits = waits_;
+    res.wait_time = wait_sec_;
+    res.timeouts = timeouts_;
+    res.rejected = rejected_;
+    res.closed = closed_;
+    res.broken = broken_;
+    res.recycled = recycled_;
+    res.affinity_hits = affinity_hits_.load(boost::memory_order_relaxed);
+    res.affinity_misses = affinity_misses_.load(boost::memory_order_relaxed);
+    res.execution_time += total_sec_;
+    res.cache += cache_stat_;
+
+    query_latency waits;
+    wait_histogram_.fill(waits);
+    res.wait_p50 = waits.p50;
+    res.wait_p99 = waits.p99;
+    res.wait_max = waits.max;
+    return res;
+}
+
+boost::shared_ptr<const backend::latency_registry> session_pool::latency_histograms() const
+{
+    return latencies_;
 }
 
-backend::connection_ptr session_pool::create_proxy(const backend::connection_ptr& conn)
+const latency_histogram& session_pool::wait_histogram() const
 {
-    return backend::connection_ptr(new connection_proxy(*this, conn));
+    return wait_histogram_;
 }
 
+session_pool::pooled_connection* session_pool::create_reserved(int priority_class)
+{
+    conn_init_callback callback;
+    std::vector<std::string> warm_up_queries;
+    double lifetime_share = 1.0;
+    double uses_share = 1.0;
+    {
+        mutex::scoped_lock g(pool_guard_);
+        callback = conn_init_callback_;
+        warm_up_queries = warm_up_queries_;
+
+        if (recycle_jitter_ > 0)
+        {
+            boost::random::uniform_real_distribution<double> jitter(1.0 - recycle_jitter_, 1.0);
+            lifetime_share = jitter(random_);
+            uses_share = jitter(random_);
+        }
+    }
+
+    try
+    {
+        pooled_connection* res = new pooled_connection(create_connection(callback, warm_up_queries));
+        res->proxy = new connection_proxy(*this, res);
+        res->retire_at = max_lifetime_ > 0 ? res->created + clock_ticks(max_lifetime_ * lifetime_share) : 0;
+        res->max_uses = max_uses_ ? (std::max)(static_cast<unsigned long long>(max_uses_ * uses_share), 1ULL) : 0;
+
+        // Proxy takes its baseline after callback and warm-up, so their work is accounted here
+        statement_cache_stat cache = res->conn->cache_stat();
+        double exec_time = res->conn->total_execution_time();
+        {
+            mutex::scoped_lock g(pool_guard_);
+            cache_stat_ += cache;
+            total_sec_ += exec_time;
+        }
+
+        return res;
+    }
+    catch(...)
+    {
+        // Give reserved place back, waiting thread may try to create connection
+        mutex::scoped_lock g(pool_guard_);
+        ++conn_left_unopened_;
+        if (priority_class >= 0 && prioritized_)
+            --classes_[priority_class].in_use;
+
+        serve_waiters();
+        throw;
+    }
+}
+
+backend::connection_ptr session_pool::create_connection(const conn_init_callback& callback, const std::vector<std::string>& warm_up_queries)
+{
+    backend::connection_ptr conn = driver_manager::create_conn(conn_info_, sm_);
+    conn->set_query_templates(templates_);
+    conn->set_latency_registry(latencies_);
+
+    if (callback)
+        // Don`t use proxy wrapper over connection because in case of exception in callback
+        // proxy wrapper will return connection that is not initialized to pool.
+        callback(session(conn));
+
+    BOOST_FOREACH(const std::string& q, warm_up_queries)
+        conn->prepare_statement(q);
+
+    return conn;
+}
+
+
 }
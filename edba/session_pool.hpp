@@ -2,14 +2,96 @@
 #define EDBA_SESSION_POOL_HPP
 
 #include <edba/session.hpp>
+#include <edba/backend/query_template_cache.hpp>
+#include <edba/backend/latency_registry.hpp>
+#include <edba/query_stats.hpp>
+#include <edba/latency_histogram.hpp>
 
 #include <boost/function.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
 #include <boost/thread/recursive_mutex.hpp>
 #include <boost/thread/condition_variable.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/chrono/chrono.hpp>
+#include <boost/random/mersenne_twister.hpp>
+
+#include <string>
+#include <vector>
+#include <list>
+#include <exception>
 
 namespace edba {
 
+/// Snapshot of session_pool state and counters
+struct session_pool_stat
+{
+    session_pool_stat()
+      : max_size(0)
+      , open(0)
+      , idle(0)
+      , borrows(0)
+      , waits(0)
+      , wait_time(0.0)
+      , timeouts(0)
+      , rejected(0)
+      , wait_p50(0.0)
+      , wait_p99(0.0)
+      , wait_max(0.0)
+      , closed(0)
+      , broken(0)
+      , recycled(0)
+      , affinity_hits(0)
+      , affinity_misses(0)
+      , execution_time(0.0)
+    {
+    }
+
+    int max_size;                   ///< Maximum number of connections
+    int open;                       ///< Number of connections created by pool
+    int idle;                       ///< Number of connections that are not used by sessions
+    unsigned long long borrows;     ///< Number of sessions given by open and try_open
+    unsigned long long waits;       ///< Number of open calls that waited for free connection
+    double wait_time;               ///< Total time in seconds spent by open calls waiting for free connection
+    unsigned long long timeouts;    ///< Number of open calls that gave up waiting at deadline
+    unsigned long long rejected;    ///< Number of open calls rejected because too many calls of their class were waiting
+    double wait_p50;                ///< Median of wait time in seconds of open calls that waited
+    double wait_p99;                ///< 99th percentile of wait time in seconds of open calls that waited
+    double wait_max;                ///< Maximum wait time in seconds
+    unsigned long long closed;      ///< Number of connections closed by pool
+    unsigned long long broken;      ///< Number of connections found broken by validation on borrow
+    unsigned long long recycled;    ///< Number of connections retired because of max lifetime or max uses
+    unsigned long long affinity_hits;   ///< Number of open calls with affinity key that got connection which served the key
+    unsigned long long affinity_misses; ///< Number of open calls with affinity key that got other connection
+    double execution_time;          ///< Same as session_pool::total_execution_time
+    statement_cache_stat cache;     ///< Same as session_pool::cache_stat
+};
+
 /// Thread-safe pool of sessions with maximum number limit
+///
+/// By default free connections are kept in list guarded by single mutex. When \@pool_shards option is set to N > 0,
+/// each thread returns connection to one of N slots and takes it back from the same slot, other free connections
+/// are kept in lock-free overflow slots. Uncontended open and return then cost a few atomic operations, mutex is
+/// locked only to create new connection or to wait for free one.
+///
+/// When \@pool_min_idle or \@pool_idle_timeout option is set, background maintainer thread keeps at least
+/// \@pool_min_idle connections ready, opening several of them in parallel, and closes connections that were idle
+/// for more than \@pool_idle_timeout seconds while more than \@pool_min_idle are idle. Maintainer is started by
+/// first open or try_open call, so connections it opens are initialized by invoke_on_connect and prepare_on_connect
+/// settings. With \@pool_prefill=on it is started by constructor, so pool that needs connection callback or warm-up
+/// queries should receive them by constructor. prefill() starts maintainer and waits for connections.
+///
+/// When \@pool_validate option is on, connection that was idle for at least \@pool_validate_idle seconds is checked
+/// by connection ping before it is given by open or try_open. Broken connection is closed and replaced by other idle
+/// or new connection transparently.
+///
+/// When \@pool_max_lifetime or \@pool_max_uses option is set, connection that lived for that many seconds or was
+/// taken that many times is retired when it is returned or while it is idle. Limit of each connection is reduced by
+/// random share up to \@pool_recycle_jitter, so connections opened together are not retired together. Maintainer
+/// closes retired connection and opens its replacement in background, open calls don`t wait for reconnect unless
+/// all other connections are busy.
 class EDBA_API session_pool
 {
 public:
@@ -18,48 +100,204 @@ public:
     /// Construct pool of session with max limit.
     /// All sessions will be created using specified \a driver and \a conn_string.
     /// Constructor doesn`t create connection itself, instead they will be created lazily by \a open and \a try_open calls.
+    /// When \@query_stats option is on, sessions are monitored by query_stats aggregator that forwards events to \a sm.
     explicit session_pool(const char* conn_string, int max_pool_size, session_monitor* sm = 0);
 
     explicit session_pool(const conn_info& ci, int max_pool_size, session_monitor* sm = 0);
 
+    /// Same as above, but connections are initialized by \a on_connect callback and \a prepare_queries from the start,
+    /// as if invoke_on_connect and prepare_on_connect were called. Connections opened by constructor with
+    /// \@pool_prefill=on are initialized too.
+    session_pool(const char* conn_string, int max_pool_size, session_monitor* sm, const conn_init_callback& on_connect, const std::vector<std::string>& prepare_queries = std::vector<std::string>());
+
+    session_pool(const conn_info& ci, int max_pool_size, session_monitor* sm, const conn_init_callback& on_connect, const std::vector<std::string>& prepare_queries = std::vector<std::string>());
+
+    ~session_pool();
+
     /// Invoke provided function object once on connection creation. This allow to setup all
     /// sessions in pool in uniform manner. configure call doesn`t affect already created sessions it will be applied only
     /// to the new one.
     void invoke_on_connect(const conn_init_callback& callback);
 
+    /// Prepare provided statements on each new connection right after it was created and initialized by
+    /// invoke_on_connect callback. Statements are put into connection statement cache, so first requests
+    /// don`t pay preparation latency. Like invoke_on_connect it doesn`t affect already created sessions.
+    void prepare_on_connect(const std::vector<std::string>& queries);
+
+    /// Open connections in parallel until \@pool_min_idle of them are idle and start pool maintainer.
+    /// Rethrow first error of opening connection.
+    void prefill();
+
     /// Get session from pool or create new one if there is no free sessions and max_pool_size limit is not exceeded.
     /// If there is no free sessions and max_pool_size limit exceeded then wait until someone will release session.
+    /// Waiting calls are served in FIFO order. With \@pool_shards option calls that don`t wait may still take
+    /// connection returned to their slot before waiting calls.
+    /// New connections are created and initialized without holding pool lock, so several of them may be opened
+    /// in parallel while other threads borrow and return sessions.
     session open();
 
+    /// Same as open(), but throw pool_timeout if there is no free session within \a timeout
+    session open(boost::chrono::steady_clock::duration timeout);
+
+    /// Same as open(), but throw pool_timeout if there is no free session before \a deadline
+    session open(boost::chrono::steady_clock::time_point deadline);
+
+    /// Define priority class of open calls and return its identifier for open and try_open.
+    /// Waiting open calls of class with higher \a priority are served first when connection is returned,
+    /// calls without class belong to class 0 with priority 0. \a reserved connections are kept for this class,
+    /// other classes can`t take them even if they are idle. When \a max_waiters calls of class are waiting,
+    /// next open calls of class throw pool_overloaded at once, negative value means no limit.
+    /// Classes should be defined before pool is used, throw edba_error if any session is taken from pool.
+    /// Pool with classes doesn`t use lock-free checkout of \@pool_shards.
+    int define_class(const std::string& name, int priority, int reserved, int max_waiters = -1);
+
+    /// Same as open(), open(timeout) and open(deadline) for open calls of \a priority_class
+    session open(int priority_class);
+    session open(int priority_class, boost::chrono::steady_clock::duration timeout);
+    session open(int priority_class, boost::chrono::steady_clock::time_point deadline);
+
     /// Get session from pool or create new one if there is no free sessions and max_pool_size limit is not exceeded.
     /// If there is no free sessions and max_pool_size limit exceeded then return false and leave sess untouched
     bool try_open(session& sess);
 
+    /// Same as try_open(sess) for open call of \a priority_class
+    bool try_open(session& sess, int priority_class);
+
+    /// Same as open(), but prefer idle connection that recently served open calls with the same \a affinity key.
+    /// Key may be hash of query text that session is going to execute or identifier of calling thread, so
+    /// statements prepared by previous sessions are found in statement cache of connection. Each connection remembers
+    /// a few of the most recent keys, key 0 means no preference.
+    session open_with_affinity(std::size_t affinity);
+
+    /// Same as try_open(sess), but prefer connection that served the same \a affinity key like open_with_affinity
+    bool try_open_with_affinity(session& sess, std::size_t affinity);
+
     /// Return total time in seconds spent by all session on query and statement execution
     double total_execution_time();
 
+    /// Return prepared statements cache counters summed over all sessions. Statistics of session is
+    /// accounted when it is returned to pool.
+    statement_cache_stat cache_stat();
+
+    /// Return execution time percentiles of statements executed by all sessions. Executions are recorded
+    /// into histograms shared by all sessions immediately, without waiting for session to be returned to pool.
+    std::vector<query_latency> query_latencies();
+
+    /// Return statistics of at most \a n normalized queries with largest total execution time.
+    /// Return empty vector if \@query_stats option is off.
+    std::vector<query_fingerprint_stat> top_queries(size_t n);
+
+    /// Return snapshot of pool state and counters
+    session_pool_stat stat();
+
+    /// Return number of sessions currently taken from pool. Unlike stat() it reads only atomic counters.
+    int busy() const;
+
+    /// Return latency histograms shared by all sessions, null if \@stmt_latency_limit option is 0
+    boost::shared_ptr<const backend::latency_registry> latency_histograms() const;
+
+    /// Return histogram of time spent by open calls waiting for free session
+    const latency_histogram& wait_histogram() const;
+
 private:
     struct connection_proxy;
+    struct pooled_connection;
+    struct idle_shard;
+    struct pool_waiter;
+    struct open_class;
 
-    typedef std::vector< backend::connection_ptr > pool_type;
+    typedef std::vector<pooled_connection*> pool_type;
     typedef boost::mutex mutex;
+    typedef boost::atomic<pooled_connection*> idle_slot;
+    struct slot_state;
 
-    backend::connection_ptr create_proxy(const backend::connection_ptr& conn);
+    session opened_session(pooled_connection* conn, std::size_t affinity, double wait_time);
+    static std::size_t connection_id(const backend::connection_ptr& conn);
+    session open_until(int priority_class, std::size_t affinity, const boost::chrono::steady_clock::time_point* deadline);
+    bool try_open_with(session& sess, int priority_class, std::size_t affinity);
+    pooled_connection* checkout(int priority_class, std::size_t affinity, bool wait, const boost::chrono::steady_clock::time_point* deadline, double& wait_time);
+    void check_class(int priority_class);
+    bool higher_priority(int c1, int c2) const;
+    bool admissible(int priority_class);
+    bool waiting_ahead(int priority_class);
+    void serve_waiters();
+    bool alive(pooled_connection* conn);
+    bool pop_idle(pooled_connection*& conn, std::size_t affinity);
+    bool take_idle(pooled_connection*& conn, std::size_t affinity);
+    void put_idle(pooled_connection* conn);
+    bool fill_slot(idle_slot& slot, slot_state& state, pooled_connection* conn);
+    void store_idle(pooled_connection* conn);
+    void release(pooled_connection* conn, double exec_time, const statement_cache_stat& cache);
+    idle_shard& home_shard();
+    void collect_shards(double& total_sec, statement_cache_stat& cache, unsigned long long& borrows);
+    int idle_slots_count();
+    pooled_connection* create_reserved(int priority_class);
+    backend::connection_ptr create_connection(const conn_init_callback& callback, const std::vector<std::string>& warm_up_queries);
+    void start_maintainer();
+    void maintain();
+    void close_expired();
+    bool recycle_due(const pooled_connection* conn) const;
+    void retire(pooled_connection* conn);
+    void replace_retired();
+    void fill_idle(bool rethrow);
+    void open_idle(std::exception_ptr& error);
+    void close(pooled_connection* conn);
 
     // NONCOPYABLE
     session_pool(const session_pool&);
     session_pool& operator=(const session_pool&);
 
     conn_info conn_info_;
+    int max_pool_size_;
     int conn_left_unopened_;
     session_monitor* sm_;
     double total_sec_;
+    statement_cache_stat cache_stat_;
+    boost::atomic<unsigned long long> borrows_;
+    boost::atomic<unsigned long long> returns_;
+    unsigned long long waits_;
+    double wait_sec_;
+    unsigned long long closed_;
+    unsigned long long broken_;
+    unsigned long long recycled_;
 
     conn_init_callback conn_init_callback_;
+    std::vector<std::string> warm_up_queries_;
+    boost::shared_ptr<backend::query_template_cache> templates_; // Parsed queries shared by all connections
+    boost::shared_ptr<backend::latency_registry> latencies_;     // Latency histograms shared by all connections
+    boost::scoped_ptr<query_stats> query_stats_;                 // Statistics of normalized queries, if enabled
 
-    pool_type pool_;
+    pool_type pool_;                                             // Free connections when pool is not sharded
     mutex pool_guard_;
-    boost::condition_variable pool_max_cv_;
+    std::vector<open_class> classes_;                            // Classes of open calls and their waiters
+    std::vector<int> classes_order_;                             // Indexes of classes in order of priority
+    boost::atomic<int> waiters_;                                 // Number of open calls waiting for free connection
+    unsigned long long timeouts_;
+    unsigned long long rejected_;
+    boost::atomic<bool> prioritized_;                            // Priority classes are defined, read by checkout and release without lock
+    boost::atomic<int> classes_count_;                           // Size of classes_, read by open calls without lock
+    boost::atomic<unsigned long long> affinity_hits_;
+    boost::atomic<unsigned long long> affinity_misses_;
+    latency_histogram wait_histogram_;
+
+    int shards_count_;
+    boost::scoped_array<idle_shard> shards_;                     // Free connection and counters per thread group
+    boost::scoped_array<idle_slot> overflow_;                    // Free connections that didn`t fit into shards
+    boost::scoped_array<slot_state> overflow_state_;             // Copies of fields of connections in overflow slots
+
+    int min_idle_;
+    double idle_timeout_;
+    bool validate_;
+    double validate_idle_;
+    double max_lifetime_;
+    unsigned long long max_uses_;
+    double recycle_jitter_;
+    boost::random::mt19937 random_;                              // Source of jitter of connection limits
+    std::vector<pooled_connection*> retired_;                    // Connections to be replaced by maintainer, their places stay reserved
+    bool stopping_;
+    boost::scoped_ptr<boost::thread> maintainer_;                // Opens and closes idle connections in background
+    boost::condition_variable maintainer_cv_;
+    mutex maintain_guard_;                                       // Serialize maintenance passes
 };
 
 }                                                                               // namespace edba
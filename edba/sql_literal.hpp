@@ -0,0 +1,192 @@
+#ifndef EDBA_SQL_LITERAL_HPP
+#define EDBA_SQL_LITERAL_HPP
+
+#include <edba/string_ref.hpp>
+
+#include <boost/config.hpp>
+
+#include <cstddef>
+
+namespace edba {
+
+///
+/// \brief Placeholder of sql_literal resolved to indexes of columns it is bound to, see sql_literal::placeholder
+///
+class sql_placeholder
+{
+public:
+    /// Maximal number of placeholders in query for which columns can be resolved
+    BOOST_STATIC_CONSTANT(std::size_t, max_columns = 64);
+
+    BOOST_CONSTEXPR sql_placeholder(const char* name, std::size_t name_size, unsigned long long columns)
+      : name_(name)
+      , name_size_(name_size)
+      , columns_(columns)
+    {
+    }
+
+    /// Return name of placeholder
+    string_ref name() const
+    {
+        return string_ref(name_, name_ + name_size_);
+    }
+
+    /// Return mask of columns, bit i is set when placeholder is bound to column i + 1. 0 if placeholder wasn`t resolved
+    BOOST_CONSTEXPR unsigned long long columns() const
+    {
+        return columns_;
+    }
+
+private:
+    const char* name_;
+    std::size_t name_size_;
+    unsigned long long columns_;
+};
+
+///
+/// \brief SQL query given as string literal with precomputed properties
+///
+/// Query text is trimmed, hashed and scanned for ':name' placeholders in constexpr constructor. Properties are
+/// guaranteed to be evaluated at compile time only when literal initializes constexpr variable and compiler
+/// supports C++14 constexpr, otherwise they are computed each time the literal is evaluated, which is still
+/// cheaper than hashing query text on every statement cache lookup. Create it with _sql suffix:
+///
+/// \code
+/// using namespace edba::literals;
+/// constexpr sql_literal q = "select name from users where id = :id"_sql;
+/// constexpr sql_placeholder id = q.placeholder("id");
+/// statement st = sess << q;
+/// st.bind(id, 10);
+/// \endcode
+///
+/// Literals that contain engine specific conditionals (start with ~) are processed as ordinary queries.
+///
+class sql_literal
+{
+public:
+    BOOST_CXX14_CONSTEXPR sql_literal(const char* str, std::size_t size)
+      : str_(str)
+      , size_(size)
+      , begin_(0)
+      , end_(size)
+      , hash_(0)
+      , bindings_count_(0)
+    {
+        while (begin_ < end_ && is_space(str_[begin_]))
+            ++begin_;
+
+        while (begin_ < end_ && is_space(str_[end_ - 1]))
+            --end_;
+
+        hash_ = detail::hash_bytes(str_ + begin_, str_ + end_);
+
+        for (std::size_t i = begin_; i < end_; ++i)
+        {
+            if (':' == str_[i])
+                ++bindings_count_;
+        }
+    }
+
+    /// Return whole query text as it was written
+    string_ref str() const
+    {
+        return string_ref(str_, size_);
+    }
+
+    /// Return query text without leading and trailing whitespaces
+    string_ref trimmed() const
+    {
+        return string_ref(str_ + begin_, str_ + end_);
+    }
+
+    /// Return hash of trimmed query text, same as string_ref_hash gives for it
+    BOOST_CONSTEXPR std::size_t hash() const
+    {
+        return hash_;
+    }
+
+    /// Return total number of ':name' placeholders in query, each occurrence of placeholder is counted
+    BOOST_CONSTEXPR std::size_t bindings_count() const
+    {
+        return bindings_count_;
+    }
+
+    /// Return true if query contains engine specific conditionals
+    BOOST_CONSTEXPR bool conditional() const
+    {
+        return begin_ != end_ && '~' == str_[begin_];
+    }
+
+    /// Return true if query text has no leading and trailing whitespaces
+    BOOST_CONSTEXPR bool is_trimmed() const
+    {
+        return 0 == begin_ && size_ == end_;
+    }
+
+    /// Resolve placeholder \a name to columns of all its occurrences. Columns are numbered in order of ':' markers
+    /// the same way for '?' and '$n' backend markers, so statement::bind(const sql_placeholder&, ...) skips lookup
+    /// of name in prepared statement. Result has no columns when query has no such placeholder, has conditionals
+    /// or has more than sql_placeholder::max_columns placeholders.
+    /// Query text is scanned by each call, so call it in constexpr context to resolve placeholder at compile time.
+    BOOST_CXX14_CONSTEXPR sql_placeholder placeholder(const char* name) const
+    {
+        std::size_t name_size = 0;
+        while (name[name_size])
+            ++name_size;
+
+        if (conditional() || bindings_count_ > sql_placeholder::max_columns)
+            return sql_placeholder(name, name_size, 0);
+
+        unsigned long long columns = 0;
+        std::size_t col = 0;
+        for (std::size_t i = begin_; i < end_; ++i)
+        {
+            if (':' != str_[i])
+                continue;
+
+            std::size_t n = 0;
+            while (n < name_size && i + 1 + n < end_ && name[n] == str_[i + 1 + n])
+                ++n;
+
+            if (n == name_size && (i + 1 + n == end_ || !is_name_char(str_[i + 1 + n])))
+                columns |= 1ull << col;
+
+            ++col;
+        }
+
+        return sql_placeholder(name, name_size, columns);
+    }
+
+private:
+    static BOOST_CONSTEXPR bool is_space(char c)
+    {
+        return ' ' == c || '\t' == c || '\n' == c || '\r' == c || '\v' == c || '\f' == c;
+    }
+
+    // Same characters as bind_by_name_helper accepts in placeholder names
+    static BOOST_CONSTEXPR bool is_name_char(char c)
+    {
+        return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') || ('0' <= c && c <= '9') || '_' == c;
+    }
+
+    const char* str_;
+    std::size_t size_;
+    std::size_t begin_;
+    std::size_t end_;
+    std::size_t hash_;
+    std::size_t bindings_count_;
+};
+
+namespace literals {
+
+/// Create sql_literal from string literal
+BOOST_CXX14_CONSTEXPR inline sql_literal operator"" _sql(const char* str, std::size_t size)
+{
+    return sql_literal(str, size);
+}
+
+}
+
+}
+
+#endif // EDBA_SQL_LITERAL_HPP
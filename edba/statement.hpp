@@ -2,6 +2,7 @@
 #define EDBA_STATEMENT_HPP
 
 #include <edba/rowset.hpp>
+#include <edba/sql_literal.hpp>
 
 #include <boost/type_traits/is_convertible.hpp>
 #include <boost/mpl/not.hpp>
@@ -105,6 +106,37 @@ public:
         return *this;
     }
 
+    /// Bind a value \a v to the placeholder resolved by sql_literal::placeholder.
+    ///
+    /// Backends that number ':placeholdername' markers by their occurrences bind value to resolved columns without
+    /// lookup of placeholder name, so placeholder must be resolved from the literal that statement was prepared from.
+    /// Other backends and unresolved placeholders are bound by name.
+    ///
+    /// Immediatelly exits for empty statements
+    template<typename T>
+    statement& bind(const sql_placeholder& p, const T& v)
+    {
+        if (stmt_)
+            bind_conversion<T>::template bind(*this, p, v);
+
+        return *this;
+    }
+
+    /// Bind a value \a v to the placeholder resolved by sql_literal::placeholder.
+    ///
+    /// Backends that number ':placeholdername' markers by their occurrences bind value to resolved columns without
+    /// lookup of placeholder name, so placeholder must be resolved from the literal that statement was prepared from.
+    /// Other backends and unresolved placeholders are bound by name.
+    ///
+    /// Immediatelly exits for empty statements
+    statement& bind(const sql_placeholder& p, const bind_types_variant& v)
+    {
+        if (stmt_)
+            stmt_->bind(p, v);
+
+        return *this;
+    }
+
     /// Bind a value \a v to the placeholder.
     ///
     /// Placeholders are marked as ':placeholdername' in the query.
@@ -0,0 +1,60 @@
+#ifndef EDBA_STATEMENT_CACHE_STAT_HPP
+#define EDBA_STATEMENT_CACHE_STAT_HPP
+
+namespace edba {
+
+///
+/// \brief Counters of prepared statements cache
+///
+/// Kept per connection, session_pool sums them over all its connections.
+///
+struct statement_cache_stat
+{
+    statement_cache_stat()
+      : hits(0)
+      , misses(0)
+      , evictions(0)
+      , entries(0)
+      , memory(0)
+      , prepare_time(0.0)
+    {
+    }
+
+    unsigned long long hits;       ///< Number of prepare_statement calls satisfied from cache
+    unsigned long long misses;     ///< Number of prepare_statement calls that have prepared new statement
+    unsigned long long evictions;  ///< Number of statements dropped from cache due to capacity or memory limit
+    long long entries;             ///< Number of statements currently held in cache
+    long long memory;              ///< Approximate memory in bytes held by statements in cache
+    double prepare_time;           ///< Total time in seconds spent on preparing new statements
+
+    statement_cache_stat& operator+=(const statement_cache_stat& other)
+    {
+        hits += other.hits;
+        misses += other.misses;
+        evictions += other.evictions;
+        entries += other.entries;
+        memory += other.memory;
+        prepare_time += other.prepare_time;
+        return *this;
+    }
+
+    statement_cache_stat& operator-=(const statement_cache_stat& other)
+    {
+        hits -= other.hits;
+        misses -= other.misses;
+        evictions -= other.evictions;
+        entries -= other.entries;
+        memory -= other.memory;
+        prepare_time -= other.prepare_time;
+        return *this;
+    }
+};
+
+inline statement_cache_stat operator-(statement_cache_stat s1, const statement_cache_stat& s2)
+{
+    return s1 -= s2;
+}
+
+}
+
+#endif // EDBA_STATEMENT_CACHE_STAT_HPP
@@ -5,6 +5,7 @@
 #include <boost/range/as_literal.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/functional/hash.hpp>
+#include <boost/config.hpp>
 
 #include <string>
 #include <ostream>
@@ -12,6 +13,26 @@
 namespace edba
 {
 
+namespace detail {
+
+/// FNV-1a hash of [b, e) range. It is constexpr in C++14, so hash of string literals
+/// can be evaluated at compile time, see sql_literal.
+BOOST_CXX14_CONSTEXPR inline std::size_t hash_bytes(const char* b, const char* e)
+{
+    std::size_t h = sizeof(std::size_t) > 4 ? std::size_t(14695981039346656037ULL) : std::size_t(2166136261UL);
+    const std::size_t prime = sizeof(std::size_t) > 4 ? std::size_t(1099511628211ULL) : std::size_t(16777619UL);
+
+    for (; b != e; ++b)
+    {
+        h ^= static_cast<unsigned char>(*b);
+        h *= prime;
+    }
+
+    return h;
+}
+
+}
+
 class string_ref : public boost::iterator_range<const char*> 
 {
 public:
@@ -69,6 +90,26 @@ struct string_ref_less
     }
 };
 
+struct string_ref_equal
+{
+    template<typename T1, typename T2>
+    bool operator()(const T1& r1, const T2& r2) const
+    {
+        return boost::algorithm::equals(to_string_ref(r1), to_string_ref(r2));
+    }
+};
+
+/// Hash functor that gives same result for std::string and string_ref with same content,
+/// allow to lookup std::string keys by string_ref without copying.
+/// Result is the same as sql_literal::hash() for the same text.
+struct string_ref_hash
+{
+    std::size_t operator()(const string_ref& str) const
+    {
+        return detail::hash_bytes(str.begin(), str.end());
+    }
+};
+
 inline std::string to_string(const string_ref& sref)
 {
     return std::string(sref.begin(), sref.end());
@@ -0,0 +1,375 @@
+#include <edba/trace_recorder.hpp>
+#include <edba/errors.hpp>
+
+#include <boost/thread/thread.hpp>
+
+#include <fstream>
+#include <iomanip>
+
+namespace edba {
+
+namespace {
+
+// Number of events in one chunk of thread buffer
+const size_t chunk_size = 1024;
+
+// Size of block for copies of query texts
+const size_t text_block_size = 64 * 1024;
+
+boost::atomic<unsigned long long> recorders_count(0);
+
+// Buffer of current thread for the last used recorder, recorder identifiers are never reused
+struct cached_buffer
+{
+    unsigned long long recorder;
+    void* buffer;
+};
+
+thread_local cached_buffer current_buffer = { 0, 0 };
+
+void write_json_string(std::ostream& os, const char* s, size_t size)
+{
+    os << '"';
+    for (const char* c = s; c != s + size; ++c)
+    {
+        if ('"' == *c || '\\' == *c)
+            os << '\\' << *c;
+        else if ('\n' == *c)
+            os << "\\n";
+        else if ('\t' == *c)
+            os << "\\t";
+        else if (static_cast<unsigned char>(*c) < 0x20)
+            os << "\\u00" << "0123456789abcdef"[(*c >> 4) & 0xf] << "0123456789abcdef"[*c & 0xf];
+        else
+            os << *c;
+    }
+    os << '"';
+}
+
+}
+
+struct trace_recorder::event
+{
+    char phase;                                   // X - complete event, b - async begin, e - async end identified by connection
+    bool ok;
+    bool has_phases;
+    const char* category;
+    const char* name;                             // Static string or copy in text blocks of thread buffer
+    size_t name_size;
+    double ts;                                    // Microseconds since recorder creation
+    double dur;                                   // Microseconds, for complete events
+    std::size_t connection;
+    execution_phases phases;
+};
+
+struct trace_recorder::chunk
+{
+    chunk() : size(0), next(0) {}
+
+    event events[chunk_size];
+    boost::atomic<size_t> size;                   // Number of published events
+    boost::atomic<chunk*> next;
+};
+
+// Written by owner thread only, read by writer of trace. Events are published by release store of chunk size
+struct trace_recorder::thread_buffer
+{
+    thread_buffer(boost::thread::id thread, int tid)
+      : thread(thread)
+      , tid(tid)
+      , head(new chunk)
+      , tail(head)
+      , events(0)
+      , dropped(0)
+      , text_used(text_block_size)
+    {
+    }
+
+    ~thread_buffer()
+    {
+        while (head)
+        {
+            chunk* next = head->next.load(boost::memory_order_relaxed);
+            delete head;
+            head = next;
+        }
+
+        for (size_t i = 0; i < text_blocks.size(); ++i)
+            delete[] text_blocks[i];
+    }
+
+    const char* store_text(const char* s, size_t size)
+    {
+        if (size > text_block_size)
+        {
+            text_blocks.push_back(new char[size]);
+            std::copy(s, s + size, text_blocks.back());
+            return text_blocks.back();
+        }
+
+        if (text_used + size > text_block_size)
+        {
+            text_blocks.push_back(new char[text_block_size]);
+            text_used = 0;
+        }
+
+        char* res = text_blocks.back() + text_used;
+        std::copy(s, s + size, res);
+        text_used += size;
+        return res;
+    }
+
+    boost::thread::id thread;
+    int tid;
+    chunk* head;
+    chunk* tail;
+    size_t events;
+    boost::atomic<unsigned long long> dropped;
+    std::vector<char*> text_blocks;
+    size_t text_used;                             // Used bytes of last text block
+};
+
+trace_recorder::trace_recorder(session_monitor* next, size_t max_events_per_thread)
+  : next_(next)
+  , max_events_per_thread_(max_events_per_thread)
+  , id_(++recorders_count)
+  , start_(boost::chrono::steady_clock::now())
+{
+}
+
+trace_recorder::~trace_recorder()
+{
+    for (size_t i = 0; i < buffers_.size(); ++i)
+        delete buffers_[i];
+}
+
+trace_recorder::thread_buffer& trace_recorder::buffer()
+{
+    if (current_buffer.recorder == id_)
+        return *static_cast<thread_buffer*>(current_buffer.buffer);
+
+    boost::thread::id thread = boost::this_thread::get_id();
+    thread_buffer* res = 0;
+
+    {
+        boost::mutex::scoped_lock g(buffers_guard_);
+        for (size_t i = 0; i < buffers_.size() && !res; ++i)
+        {
+            if (buffers_[i]->thread == thread)
+                res = buffers_[i];
+        }
+
+        if (!res)
+        {
+            buffers_.reserve(buffers_.size() + 1);
+            res = new thread_buffer(thread, static_cast<int>(buffers_.size()) + 1);
+            buffers_.push_back(res);
+        }
+    }
+
+    current_buffer.recorder = id_;
+    current_buffer.buffer = res;
+    return *res;
+}
+
+double trace_recorder::now() const
+{
+    return boost::chrono::duration<double, boost::micro>(boost::chrono::steady_clock::now() - start_).count();
+}
+
+void trace_recorder::add(
+    char phase
+  , const char* category
+  , const char* name
+  , size_t name_size
+  , double duration
+  , const execution_phases* phases
+  , bool ok
+  , std::size_t connection
+  )
+{
+    thread_buffer& b = buffer();
+    if (b.events >= max_events_per_thread_)
+    {
+        b.dropped.fetch_add(1, boost::memory_order_relaxed);
+        return;
+    }
+
+    chunk* c = b.tail;
+    size_t n = c->size.load(boost::memory_order_relaxed);
+    if (chunk_size == n)
+    {
+        chunk* next = new chunk;
+        c->next.store(next, boost::memory_order_release);
+        b.tail = c = next;
+        n = 0;
+    }
+
+    event& e = c->events[n];
+    e.phase = phase;
+    e.ok = ok;
+    e.category = category;
+    e.name = 'X' == phase ? b.store_text(name, name_size) : name;
+    e.name_size = name_size;
+    e.dur = duration * 1e6;
+    e.ts = now() - e.dur;
+    e.connection = connection;
+    e.has_phases = phases != 0;
+    if (phases)
+        e.phases = *phases;
+
+    c->size.store(n + 1, boost::memory_order_release);
+    ++b.events;
+}
+
+void trace_recorder::write(std::ostream& os) const
+{
+    std::vector<thread_buffer*> buffers;
+    {
+        boost::mutex::scoped_lock g(buffers_guard_);
+        buffers = buffers_;
+    }
+
+    std::ios_base::fmtflags flags = os.flags();
+    std::streamsize precision = os.precision();
+    os << std::fixed << std::setprecision(3);
+
+    os << "{\"traceEvents\":[";
+
+    bool first = true;
+    for (size_t i = 0; i < buffers.size(); ++i)
+    {
+        for (const chunk* c = buffers[i]->head; c; c = c->next.load(boost::memory_order_acquire))
+        {
+            size_t size = c->size.load(boost::memory_order_acquire);
+            for (size_t j = 0; j < size; ++j)
+            {
+                const event& e = c->events[j];
+
+                os << (first ? "\n" : ",\n") << "{\"name\":";
+                write_json_string(os, e.name, e.name_size);
+                os << ",\"cat\":\"" << e.category << "\",\"ph\":\"" << e.phase << "\",\"ts\":" << e.ts;
+                if ('X' == e.phase)
+                    os << ",\"dur\":" << e.dur;
+                else
+                    os << ",\"id\":\"0x" << std::hex << e.connection << std::dec << '"';
+                os << ",\"pid\":1,\"tid\":" << buffers[i]->tid;
+                os << ",\"args\":{\"connection\":" << e.connection << ",\"ok\":" << (e.ok ? "true" : "false");
+                if (e.has_phases)
+                {
+                    os << ",\"rows\":" << e.phases.rows
+                       << ",\"prepare_us\":" << e.phases.prepare_time * 1e6
+                       << ",\"bind_us\":" << e.phases.bind_time * 1e6
+                       << ",\"execute_us\":" << e.phases.execute_time * 1e6
+                       << ",\"first_row_us\":" << e.phases.first_row_time * 1e6
+                       << ",\"fetch_us\":" << e.phases.fetch_time * 1e6;
+                }
+                os << "}}";
+
+                first = false;
+            }
+        }
+    }
+
+    os << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+    os.flags(flags);
+    os.precision(precision);
+}
+
+void trace_recorder::save(const std::string& path) const
+{
+    std::ofstream f(path.c_str(), std::ios_base::out | std::ios_base::trunc);
+    if (!f)
+        throw edba_error("edba::trace_recorder: can`t open file " + path);
+
+    write(f);
+    f.close();
+
+    if (!f)
+        throw edba_error("edba::trace_recorder: can`t write file " + path);
+}
+
+unsigned long long trace_recorder::dropped() const
+{
+    unsigned long long res = 0;
+
+    boost::mutex::scoped_lock g(buffers_guard_);
+    for (size_t i = 0; i < buffers_.size(); ++i)
+        res += buffers_[i]->dropped.load(boost::memory_order_relaxed);
+
+    return res;
+}
+
+void trace_recorder::statement_executed(const char* sql, const bound_params& bindings, bool ok, double execution_time, unsigned long long rows_affected)
+{
+    // Events are recorded by overloads with execution phases, bindings are not formatted
+    if (next_)
+        next_->statement_executed(sql, bindings, ok, execution_time, rows_affected);
+}
+
+void trace_recorder::query_executed(const char* sql, const bound_params& bindings, bool ok, double execution_time, unsigned long long rows_read)
+{
+    if (next_)
+        next_->query_executed(sql, bindings, ok, execution_time, rows_read);
+}
+
+void trace_recorder::statement_executed(const char* sql, const bound_params& bindings, bool ok, const execution_phases& phases)
+{
+    add('X', "statement", sql, std::char_traits<char>::length(sql), phases.execute_time, &phases, ok, phases.connection);
+
+    if (next_)
+        next_->statement_executed(sql, bindings, ok, phases);
+}
+
+void trace_recorder::query_executed(const char* sql, const bound_params& bindings, bool ok, const execution_phases& phases)
+{
+    add('X', "query", sql, std::char_traits<char>::length(sql), phases.execute_time + phases.fetch_time, &phases, ok, phases.connection);
+
+    if (next_)
+        next_->query_executed(sql, bindings, ok, phases);
+}
+
+void trace_recorder::transaction_started(std::size_t connection)
+{
+    add('b', "transaction", "transaction", 11, 0.0, 0, true, connection);
+
+    if (next_)
+        next_->transaction_started(connection);
+}
+
+void trace_recorder::transaction_committed(std::size_t connection)
+{
+    add('e', "transaction", "transaction", 11, 0.0, 0, true, connection);
+
+    if (next_)
+        next_->transaction_committed(connection);
+}
+
+void trace_recorder::transaction_reverted(std::size_t connection)
+{
+    add('e', "transaction", "transaction", 11, 0.0, 0, false, connection);
+
+    if (next_)
+        next_->transaction_reverted(connection);
+}
+
+void trace_recorder::session_opened(std::size_t connection, double wait_time)
+{
+    if (wait_time > 0)
+        add('X', "pool", "wait for connection", 19, wait_time, 0, true, connection);
+    add('b', "pool", "session", 7, 0.0, 0, true, connection);
+
+    if (next_)
+        next_->session_opened(connection, wait_time);
+}
+
+void trace_recorder::session_closed(std::size_t connection)
+{
+    add('e', "pool", "session", 7, 0.0, 0, true, connection);
+
+    if (next_)
+        next_->session_closed(connection);
+}
+
+}
@@ -0,0 +1,83 @@
+#ifndef EDBA_TRACE_RECORDER_HPP
+#define EDBA_TRACE_RECORDER_HPP
+
+#include <edba/session_monitor.hpp>
+#include <edba/detail/exports.hpp>
+
+#include <boost/atomic.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/chrono/chrono.hpp>
+
+#include <ostream>
+#include <vector>
+#include <string>
+
+namespace edba {
+
+///
+/// \brief session_monitor that records timeline of database activity in Chrome trace event format
+///
+/// Queries, statements, transactions, sessions taken from session_pool and waits for free pool connection
+/// are recorded as events with thread and connection identifiers. Written trace can be opened by chrome://tracing
+/// or https://ui.perfetto.dev.
+///
+/// Each thread records events into its own append-only buffer without locks, buffers may be written while
+/// recording continues. Events of thread above \a max_events_per_thread limit are dropped.
+/// Queries are reported when their result is destroyed, so query events cover both execution and fetching.
+/// Every event carries identifier of connection. Sessions and transactions are recorded as async events identified
+/// by connection, so sessions of one thread may be returned in any order or by another thread.
+/// All events are forwarded to \a next monitor if it is set.
+///
+class EDBA_API trace_recorder : public session_monitor, boost::noncopyable
+{
+public:
+    explicit trace_recorder(session_monitor* next = 0, size_t max_events_per_thread = 1000000);
+    ~trace_recorder();
+
+    ///
+    /// Write all recorded events to \a os as JSON object in Chrome trace event format
+    ///
+    void write(std::ostream& os) const;
+
+    ///
+    /// Write all recorded events to file \a path, throw edba_error if file can`t be written
+    ///
+    void save(const std::string& path) const;
+
+    ///
+    /// Return number of events dropped because of max_events_per_thread limit
+    ///
+    unsigned long long dropped() const;
+
+    virtual void statement_executed(const char* sql, const bound_params& bindings, bool ok, double execution_time, unsigned long long rows_affected);
+    virtual void query_executed(const char* sql, const bound_params& bindings, bool ok, double execution_time, unsigned long long rows_read);
+    virtual void statement_executed(const char* sql, const bound_params& bindings, bool ok, const execution_phases& phases);
+    virtual void query_executed(const char* sql, const bound_params& bindings, bool ok, const execution_phases& phases);
+    virtual void transaction_started(std::size_t connection);
+    virtual void transaction_committed(std::size_t connection);
+    virtual void transaction_reverted(std::size_t connection);
+    virtual void session_opened(std::size_t connection, double wait_time);
+    virtual void session_closed(std::size_t connection);
+
+private:
+    struct event;
+    struct chunk;
+    struct thread_buffer;
+
+    thread_buffer& buffer();
+    void add(char phase, const char* category, const char* name, size_t name_size, double duration, const execution_phases* phases, bool ok, std::size_t connection);
+    double now() const;
+
+    session_monitor* next_;
+    size_t max_events_per_thread_;
+    unsigned long long id_;                       // Unique identifier of recorder, used to find buffer of thread
+    boost::chrono::steady_clock::time_point start_;
+
+    std::vector<thread_buffer*> buffers_;
+    mutable boost::mutex buffers_guard_;          // Guard buffers_ list only, buffers themselves are not locked
+};
+
+}
+
+#endif // EDBA_TRACE_RECORDER_HPP
@@ -1,4 +1,5 @@
 #include <edba/detail/bind_by_name_helper.hpp>
+#include <edba/backend/query_template_cache.hpp>
 
 #include <boost/test/unit_test.hpp>
 
@@ -23,3 +24,18 @@ BOOST_AUTO_TEST_CASE(BindByNameHelper)
     BOOST_CHECK_EQUAL_COLLECTIONS(qp1.begin(), qp1.end(), expected.begin(), expected.end()); 
     BOOST_CHECK_EQUAL_COLLECTIONS(pp1.begin(), pp1.end(), expected.begin(), expected.end()); 
 }
+
+BOOST_AUTO_TEST_CASE(QueryTemplateCache)
+{
+    backend::query_template_cache cache;
+
+    detail::query_template_ptr t1 = cache.get("zzz :p1,:2p,:p1 zzz", detail::postgresql_style_marker());
+    detail::query_template_ptr t2 = cache.get("zzz :p1,:2p,:p1 zzz", detail::postgresql_style_marker());
+
+    BOOST_CHECK(t1 == t2);
+    BOOST_CHECK_EQUAL(cache.size(), 1u);
+
+    detail::bind_by_name_helper shared(t1);
+    BOOST_CHECK_EQUAL(shared.bindings_count(), 3);
+    BOOST_CHECK_EQUAL(shared.patched_query(), boost::as_literal("zzz $1,$2,$3 zzz"));
+}
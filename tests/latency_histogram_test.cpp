@@ -0,0 +1,121 @@
+#include <edba/edba.hpp>
+
+#include <boost/thread/thread.hpp>
+#include <boost/bind/bind.hpp>
+
+#include <boost/test/unit_test.hpp>
+
+#include <cmath>
+
+using namespace std;
+using namespace edba;
+
+namespace {
+
+void record_many(latency_histogram& h, double sec, int times)
+{
+    for (int i = 0; i < times; ++i)
+        h.record(sec);
+}
+
+const query_latency* find_latency(const vector<query_latency>& latencies, const string& q)
+{
+    for (size_t i = 0; i < latencies.size(); ++i)
+        if (latencies[i].query == q)
+            return &latencies[i];
+
+    return 0;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(LatencyHistogramBuckets)
+{
+    for (boost::uint64_t ns = 0; ns < (boost::uint64_t(1) << 20); ns = ns * 9 / 8 + 1)
+    {
+        int idx = latency_histogram::bucket_index(ns);
+        BOOST_REQUIRE(idx < latency_histogram::buckets);
+        BOOST_CHECK_LE(std::abs(latency_histogram::bucket_middle(idx) - ns), ns / 16.0 + 0.5);
+    }
+
+    BOOST_CHECK_EQUAL(latency_histogram::bucket_index(boost::uint64_t(-1)), latency_histogram::buckets - 1);
+}
+
+BOOST_AUTO_TEST_CASE(LatencyHistogramPercentiles)
+{
+    latency_histogram h;
+    record_many(h, 0.001, 990);
+    record_many(h, 0.1, 9);
+    h.record(1.0);
+
+    query_latency res;
+    h.fill(res);
+
+    BOOST_CHECK_EQUAL(res.count, 1000u);
+    BOOST_CHECK_CLOSE(res.p50, 0.001, 6.25);
+    BOOST_CHECK_CLOSE(res.p99, 0.1, 6.25);
+    BOOST_CHECK_CLOSE(res.p999, 1.0, 6.25);
+    BOOST_CHECK_CLOSE(res.max, 1.0, 0.001);
+    BOOST_CHECK_CLOSE(res.total_time, 990 * 0.001 + 9 * 0.1 + 1.0, 0.001);
+}
+
+BOOST_AUTO_TEST_CASE(LatencyHistogramConcurrentRecord)
+{
+    latency_histogram h;
+
+    boost::thread_group threads;
+    for (int i = 0; i < 8; ++i)
+        threads.create_thread(boost::bind(&record_many, boost::ref(h), 0.0001, 10000));
+    threads.join_all();
+
+    BOOST_CHECK_EQUAL(h.count(), 80000u);
+}
+
+BOOST_AUTO_TEST_CASE(LatencyHistogramSession)
+{
+    session sess("sqlite3:db=:memory:");
+
+    for (int i = 0; i < 10; ++i)
+        sess << "select 1" << first_row;
+
+    const query_latency* l = find_latency(sess.query_latencies(), "select 1");
+    BOOST_REQUIRE(l);
+    BOOST_CHECK_EQUAL(l->count, 10u);
+    BOOST_CHECK_LE(l->p50, l->max);
+
+    session off("sqlite3:db=:memory:;@stmt_latency_limit=0");
+    off << "select 1" << first_row;
+    BOOST_CHECK(off.query_latencies().empty());
+
+    // One-off and not cached statements are not recorded
+    sess.once() << "select 2" << first_row;
+    BOOST_CHECK(!find_latency(sess.query_latencies(), "select 2"));
+
+    session uncached("sqlite3:db=:memory:;@stmt_cache_size=0");
+    uncached << "select 1" << first_row;
+    BOOST_CHECK(uncached.query_latencies().empty());
+}
+
+BOOST_AUTO_TEST_CASE(LatencyHistogramSessionPool)
+{
+    session_pool pool("sqlite3:db=:memory:", 2);
+
+    {
+        session s1 = pool.open();
+        session s2 = pool.open();
+
+        s1 << "select 1" << first_row;
+        s2 << "select 1" << first_row;
+        s2 << "select 2" << first_row;
+
+        // Recorded without waiting for sessions to return to pool
+        const query_latency* l = find_latency(pool.query_latencies(), "select 1");
+        BOOST_REQUIRE(l);
+        BOOST_CHECK_EQUAL(l->count, 2u);
+        BOOST_CHECK_EQUAL(s1.query_latencies().size(), 2u);
+    }
+
+    const query_latency* l = find_latency(pool.query_latencies(), "select 2");
+    BOOST_REQUIRE(l);
+    BOOST_CHECK_EQUAL(l->count, 1u);
+}
@@ -0,0 +1,41 @@
+#include <edba/edba.hpp>
+#include <edba/prometheus.hpp>
+
+#include <boost/algorithm/string/predicate.hpp>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+using namespace edba;
+
+BOOST_AUTO_TEST_CASE(PrometheusSessionPool)
+{
+    session_pool pool("sqlite3:db=:memory:", 2);
+
+    {
+        session sess = pool.open();
+        for (int i = 0; i < 3; ++i)
+            sess << "select \"a\" || '\\'" << first_row;
+
+        sess.once() << "create temp table t(id integer primary key)" << exec;
+        sess << "insert into t(id) values(1)" << exec;
+        BOOST_CHECK_THROW(sess << "insert into t(id) values(1)" << exec, edba_error);
+    }
+
+    string text = prometheus_text(pool, "db");
+
+    BOOST_CHECK(boost::contains(text, "# TYPE db_pool_connections_max gauge\ndb_pool_connections_max 2\n"));
+    BOOST_CHECK(boost::contains(text, "\ndb_pool_connections_open 1\n"));
+    BOOST_CHECK(boost::contains(text, "\ndb_pool_connections_idle 1\n"));
+    BOOST_CHECK(boost::contains(text, "\ndb_pool_borrows_total 1\n"));
+    BOOST_CHECK(boost::contains(text, "\ndb_pool_timeouts_total 0\n"));
+    BOOST_CHECK(boost::contains(text, "# TYPE db_pool_wait_seconds histogram\n"));
+    BOOST_CHECK(boost::contains(text, "\ndb_pool_wait_seconds_bucket{le=\"+Inf\"} 0\n"));
+    BOOST_CHECK(boost::contains(text, "\ndb_pool_wait_seconds_count 0\n"));
+    BOOST_CHECK(!boost::contains(text, "db_pool_wait_seconds_total"));
+    BOOST_CHECK(boost::contains(text, "\ndb_statement_cache_misses_total 2\n"));
+    BOOST_CHECK(boost::contains(text, "# TYPE db_statement_duration_seconds histogram\n"));
+    BOOST_CHECK(boost::contains(text, "\ndb_statement_duration_seconds_count{query=\"select \\\"a\\\" || '\\\\'\"} 3\n"));
+    BOOST_CHECK(boost::contains(text, "db_statement_duration_seconds_bucket{query=\"select \\\"a\\\" || '\\\\'\",le=\"+Inf\"} 3\n"));
+    BOOST_CHECK(boost::contains(text, "\ndb_statement_errors_total{query=\"insert into t(id) values(1)\"} 1\n"));
+}
@@ -0,0 +1,65 @@
+#include <edba/edba.hpp>
+#include <edba/query_stats.hpp>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+using namespace edba;
+
+BOOST_AUTO_TEST_CASE(QueryStatsNormalize)
+{
+    BOOST_CHECK_EQUAL(normalize_query("  select *\n  from t   where id = 42"), "select * from t where id = ?");
+    BOOST_CHECK_EQUAL(normalize_query("select 'it''s', -1.5e+3, 0x1F from t1"), "select ?, -?, ? from t1");
+    BOOST_CHECK_EQUAL(normalize_query("select \"Col 1\" from t -- comment\nwhere a = /* x */ $1"), "select \"Col 1\" from t where a = ?");
+    BOOST_CHECK_EQUAL(normalize_query("select a::int from t where b = :name and c = ? and d = @p"), "select a::int from t where b = ? and c = ? and d = ?");
+    BOOST_CHECK_EQUAL(normalize_query("select * from t where id in (1, 2, 3) and x IN(?)"), "select * from t where id in (...) and x IN(...)");
+    BOOST_CHECK_EQUAL(normalize_query("select * from t where id in (select id from t2)"), "select * from t where id in (select id from t2)");
+}
+
+BOOST_AUTO_TEST_CASE(QueryStatsSessionPool)
+{
+    session_pool pool("sqlite3:db=:memory:;@query_stats=on", 1);
+
+    {
+        session sess = pool.open();
+        sess.once() << "create table t(id integer primary key)" << exec;
+
+        for (int i = 0; i < 5; ++i)
+            sess.once() << "insert into t(id) values(" + boost::lexical_cast<string>(i) + ")" << exec;
+
+        rowset<> rs = sess << "select id from t where id in (1, 2, 3)";
+        for (rowset<>::iterator i = rs.begin(); i != rs.end(); ++i)
+            ;
+
+        // Execution fails with constraint violation
+        BOOST_CHECK_THROW(sess.once() << "insert into t(id) values(1)" << exec, edba_error);
+    }
+
+    vector<query_fingerprint_stat> top = pool.top_queries(10);
+    BOOST_REQUIRE_EQUAL(top.size(), 3u);
+
+    for (size_t i = 1; i < top.size(); ++i)
+        BOOST_CHECK_GE(top[i - 1].total_time, top[i].total_time);
+
+    for (size_t i = 0; i < top.size(); ++i)
+    {
+        if (top[i].query == "insert into t(id) values(?)")
+        {
+            BOOST_CHECK_EQUAL(top[i].calls, 6u);
+            BOOST_CHECK_EQUAL(top[i].errors, 1u);
+            BOOST_CHECK_EQUAL(top[i].rows, 5u);
+            BOOST_CHECK_LE(top[i].min_time, top[i].max_time);
+        }
+        else if (top[i].query == "select id from t where id in (...)")
+            BOOST_CHECK_EQUAL(top[i].rows, 3u);
+        else
+            BOOST_CHECK_EQUAL(top[i].query, "create table t(id integer primary key)");
+    }
+
+    BOOST_CHECK_EQUAL(pool.top_queries(1).size(), 1u);
+    BOOST_CHECK(session_pool("sqlite3:db=:memory:", 1).top_queries(10).empty());
+
+    // Sampled or filtered executions would be undercounted
+    BOOST_CHECK_THROW(session_pool("sqlite3:db=:memory:;@query_stats=on;@monitor_sample_rate=10", 1), edba_error);
+    BOOST_CHECK_THROW(session_pool("sqlite3:db=:memory:;@query_stats=on;@monitor_slow_ms=5", 1), edba_error);
+}
@@ -0,0 +1,96 @@
+#include <edba/edba.hpp>
+
+#include <boost/algorithm/string/predicate.hpp>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+using namespace edba;
+
+namespace {
+
+void create_endpoint(const string& conn_str, const string& name)
+{
+    session sess(conn_str);
+    sess.once() << "drop table if exists endpoint" << exec;
+    sess.once() << "create table endpoint(name text)" << exec;
+    sess.once() << "insert into endpoint(name) values(:name)" << name << exec;
+}
+
+string endpoint_name(session& sess)
+{
+    string name;
+    sess << "select name from endpoint" << first_row >> name;
+    return name;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(RoutingPoolReadWriteSplit)
+{
+    create_endpoint("sqlite3:db=routing_primary.db", "primary");
+    create_endpoint("sqlite3:db=routing_replica1.db", "replica1");
+    create_endpoint("sqlite3:db=routing_replica2.db", "replica2");
+
+    vector<string> replicas;
+    replicas.push_back("sqlite3:db=routing_replica1.db");
+    replicas.push_back("sqlite3:db=routing_replica2.db");
+
+    routing_pool pool("sqlite3:db=routing_primary.db", replicas, 1);
+    BOOST_CHECK_EQUAL(pool.replicas_count(), 2u);
+
+    session w = pool.open_write();
+    BOOST_CHECK_EQUAL(endpoint_name(w), "primary");
+    w = session();
+
+    // Reads are spread over replicas by number of taken sessions
+    session r1 = pool.open_read();
+    session r2 = pool.open_read();
+    string n1 = endpoint_name(r1);
+    string n2 = endpoint_name(r2);
+    BOOST_CHECK(n1 != n2);
+    BOOST_CHECK(boost::starts_with(n1, "replica"));
+    BOOST_CHECK(boost::starts_with(n2, "replica"));
+    BOOST_CHECK_EQUAL(pool.replica(0).busy(), 1);
+    BOOST_CHECK_EQUAL(pool.replica(1).busy(), 1);
+    BOOST_CHECK_EQUAL(pool.primary_reads(), 0u);
+
+    // All replicas are busy, read goes to primary
+    session r3 = pool.open_read();
+    BOOST_CHECK_EQUAL(endpoint_name(r3), "primary");
+    BOOST_CHECK_EQUAL(pool.primary_reads(), 1u);
+
+    r1 = session();
+    session r4 = pool.open_read();
+    BOOST_CHECK_EQUAL(endpoint_name(r4), n1);
+    BOOST_CHECK_EQUAL(pool.replica(0).stat().borrows + pool.replica(1).stat().borrows, 3u);
+}
+
+BOOST_AUTO_TEST_CASE(RoutingPoolBrokenReplica)
+{
+    create_endpoint("sqlite3:db=routing_primary.db", "primary");
+    create_endpoint("sqlite3:db=routing_replica1.db", "replica1");
+
+    vector<string> replicas;
+    replicas.push_back("sqlite3:db=no_such_dir/routing_replica.db;mode=readonly");
+    replicas.push_back("sqlite3:db=routing_replica1.db");
+
+    routing_pool pool("sqlite3:db=routing_primary.db", replicas, 2);
+
+    // Replica that can`t be connected is skipped
+    for (int i = 0; i < 4; ++i)
+    {
+        session sess = pool.open_read();
+        BOOST_CHECK_EQUAL(endpoint_name(sess), "replica1");
+    }
+
+    BOOST_CHECK_EQUAL(pool.replica(0).stat().open, 0);
+    BOOST_CHECK_EQUAL(pool.primary_reads(), 0u);
+
+    vector<string> broken(1, "sqlite3:db=no_such_dir/routing_replica.db;mode=readonly");
+    routing_pool fallback("sqlite3:db=routing_primary.db", broken, 1);
+
+    session sess = fallback.open_read();
+    BOOST_CHECK_EQUAL(endpoint_name(sess), "primary");
+    BOOST_CHECK_EQUAL(fallback.primary_reads(), 1u);
+}
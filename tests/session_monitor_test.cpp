@@ -0,0 +1,188 @@
+#include <edba/edba.hpp>
+#include <edba/session_monitor.hpp>
+
+#include <boost/chrono/thread_clock.hpp>
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+using namespace edba;
+
+namespace {
+
+struct text_monitor : session_monitor
+{
+    virtual void query_executed(const char*, const std::string& bindings, bool, double, unsigned long long)
+    {
+        last_bindings_ = bindings;
+    }
+
+    std::string last_bindings_;
+};
+
+struct lazy_monitor : session_monitor
+{
+    lazy_monitor() : count_(0) {}
+
+    virtual void query_executed(const char*, const bound_params& bindings, bool, double, unsigned long long)
+    {
+        count_ = bindings.size();
+    }
+
+    size_t count_;
+};
+
+struct phases_monitor : session_monitor
+{
+    phases_monitor() : queries_(0), statements_(0) {}
+
+    virtual void query_executed(const char*, const bound_params&, bool, const execution_phases& phases)
+    {
+        ++queries_;
+        last_ = phases;
+    }
+
+    virtual void statement_executed(const char*, const bound_params&, bool, const execution_phases& phases)
+    {
+        ++statements_;
+        last_ = phases;
+    }
+
+    int queries_;
+    int statements_;
+    execution_phases last_;
+};
+
+}
+
+BOOST_AUTO_TEST_CASE(SessionMonitorBindings)
+{
+    text_monitor m;
+    session sess("sqlite3:db=:memory:", &m);
+
+    {
+        string tmp = "abc";
+        sess << "select :a, :b, :c, :d" << use("a", 1) << tmp << null << 2.5 << first_row;
+    }
+    BOOST_CHECK_EQUAL(m.last_bindings_, "['a', '1'][1, 'abc'][2, (NULL)][3, '2.5']");
+
+    statement st = sess << "select :a, :b, :c, :d";
+    st.bind(1, string("tmp")).bind(2, 2).bind(3, 3).bind(4, 4);
+    st.first_row();
+    BOOST_CHECK_EQUAL(m.last_bindings_, "[1, 'tmp'][2, '2'][3, '3'][4, '4']");
+}
+
+BOOST_AUTO_TEST_CASE(SessionMonitorLazyBindings)
+{
+    lazy_monitor m;
+    session sess("sqlite3:db=:memory:", &m);
+
+    sess << "select :a, :b" << 1 << "x" << first_row;
+    BOOST_CHECK_EQUAL(m.count_, 2u);
+}
+
+BOOST_AUTO_TEST_CASE(SessionMonitorPhases)
+{
+    phases_monitor m;
+    session sess("sqlite3:db=:memory:", &m);
+
+    sess.once() << "create table t(id integer)" << exec;
+    BOOST_CHECK_EQUAL(m.statements_, 1);
+
+    statement ins = sess << "insert into t(id) values(:id)";
+    for (int i = 0; i < 3; ++i)
+        ins << reset << i << exec;
+
+    BOOST_CHECK_EQUAL(m.statements_, 4);
+    BOOST_CHECK_EQUAL(m.last_.rows, 1u);
+    BOOST_CHECK_EQUAL(m.last_.prepare_time, 0.0);
+    BOOST_CHECK_GE(m.last_.bind_time, 0.0);
+
+    {
+        rowset<int> rs = sess << "select id from t order by id";
+
+        // Query is reported only when result is destroyed
+        BOOST_CHECK_EQUAL(m.queries_, 0);
+
+        int sum = 0;
+        BOOST_FOREACH(int id, rs)
+            sum += id;
+
+        BOOST_CHECK_EQUAL(sum, 3);
+    }
+
+    BOOST_CHECK_EQUAL(m.queries_, 1);
+    BOOST_CHECK_EQUAL(m.last_.rows, 3u);
+    BOOST_CHECK_GT(m.last_.prepare_time, 0.0);
+    BOOST_CHECK_GE(m.last_.fetch_time, m.last_.first_row_time);
+
+    BOOST_CHECK_EQUAL((sess << "select count(*) from t" << first_row).get<int>(0), 3);
+    BOOST_CHECK_EQUAL(m.queries_, 2);
+    BOOST_CHECK_EQUAL(m.last_.rows, 1u);
+
+    BOOST_CHECK_THROW(sess << "select bad syntax from" << first_row, edba_error);
+}
+
+BOOST_AUTO_TEST_CASE(SessionMonitorSampling)
+{
+    lazy_monitor m;
+    phases_monitor pm;
+
+    {
+        session sess("sqlite3:db=:memory:;@monitor_sample_rate=3", &pm);
+
+        statement st = sess << "select :a";
+        for (int i = 0; i < 9; ++i)
+            st << reset << i << first_row;
+
+        BOOST_CHECK_EQUAL(pm.queries_, 3);
+    }
+
+    {
+        // Nothing is slower then an hour
+        session sess("sqlite3:db=:memory:;@monitor_slow_ms=3600000", &m);
+        sess << "select :a, :b" << 1 << 2 << first_row;
+        BOOST_CHECK_EQUAL(m.count_, 0u);
+    }
+
+    {
+        // Failed executions are reported however fast they are
+        phases_monitor failures;
+        session sess("sqlite3:db=:memory:;@monitor_slow_ms=3600000", &failures);
+        sess.once() << "create table t(id integer primary key)" << exec;
+        sess.once() << "insert into t(id) values(1)" << exec;
+        BOOST_CHECK_THROW(sess.once() << "insert into t(id) values(1)" << exec, edba_error);
+        sess << "select 1" << first_row;
+        BOOST_CHECK_EQUAL(failures.statements_, 1);
+        BOOST_CHECK_EQUAL(failures.queries_, 0);
+    }
+
+    {
+        session sess("sqlite3:db=:memory:;@monitor_slow_ms=0.0", &m);
+        sess << "select :a, :b" << 1 << 2 << first_row;
+        BOOST_CHECK_EQUAL(m.count_, 2u);
+    }
+
+    BOOST_CHECK_THROW(session("sqlite3:db=:memory:;@monitor_sample_rate=0"), edba_error);
+    BOOST_CHECK_THROW(session("sqlite3:db=:memory:;@monitor_slow_ms=fast"), edba_error);
+}
+
+BOOST_AUTO_TEST_CASE(SessionMonitorCpuTime)
+{
+    phases_monitor m;
+
+    {
+        session sess("sqlite3:db=:memory:", &m);
+        sess << "select 1" << first_row;
+        BOOST_CHECK_EQUAL(m.last_.cpu_time, -1.0);
+    }
+
+#if defined(BOOST_CHRONO_HAS_THREAD_CLOCK)
+    {
+        session sess("sqlite3:db=:memory:;@monitor_cpu_time=on", &m);
+        sess << "select 1" << first_row;
+        BOOST_CHECK_GE(m.last_.cpu_time, 0.0);
+    }
+#endif
+
+    BOOST_CHECK_THROW(session("sqlite3:db=:memory:;@monitor_cpu_time=yes"), edba_error);
+}
@@ -0,0 +1,120 @@
+#include <edba/edba.hpp>
+
+#include <boost/thread/thread.hpp>
+#include <boost/chrono/chrono.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/atomic.hpp>
+
+#include <iostream>
+#include <new>
+#include <cstdlib>
+
+using namespace std;
+using namespace edba;
+
+namespace {
+
+boost::atomic<unsigned long long> allocations(0);
+
+}
+
+void* operator new(size_t size)
+{
+    allocations.fetch_add(1, boost::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace {
+
+const int borrows_per_thread = 200000;
+
+typedef boost::chrono::steady_clock bench_clock;
+
+void borrow_loop(session_pool& pool)
+{
+    for (int i = 0; i < borrows_per_thread; ++i)
+        pool.open();
+}
+
+// Return average time between borrows in nanoseconds, when every thread has own connection
+double checkout_cost(const string& conn_str, int threads)
+{
+    session_pool pool(conn_str.c_str(), threads);
+
+    // Create all connections before measurement
+    {
+        vector<session> sessions;
+        for (int i = 0; i < threads; ++i)
+            sessions.push_back(pool.open());
+    }
+
+    bench_clock::time_point start = bench_clock::now();
+
+    boost::thread_group tg;
+    for (int i = 0; i < threads; ++i)
+        tg.create_thread(boost::bind(borrow_loop, boost::ref(pool)));
+    tg.join_all();
+
+    return boost::chrono::duration<double, boost::nano>(bench_clock::now() - start).count() / (borrows_per_thread * threads);
+}
+
+// Return average number of heap allocations per borrow of already opened connection
+double borrow_allocations(const string& conn_str)
+{
+    session_pool pool(conn_str.c_str(), 1);
+    pool.open();
+
+    unsigned long long before = allocations.load();
+    borrow_loop(pool);
+
+    return static_cast<double>(allocations.load() - before) / borrows_per_thread;
+}
+
+}
+
+int main()
+{
+    try
+    {
+        int shards = static_cast<int>(boost::thread::hardware_concurrency());
+        string sharded = "sqlite3:db=:memory:;@pool_shards=" + boost::lexical_cast<string>(shards > 0 ? shards : 1);
+
+        cout << "session_pool open and return, ns per borrow" << endl;
+        cout << "threads  mutex       sharded" << endl;
+
+        const int threads[] = {1, 2, 4, 8, 16, 32, 64};
+        for (size_t i = 0; i < sizeof(threads) / sizeof(threads[0]); ++i)
+        {
+            cout.width(7);
+            cout << threads[i] << "  ";
+            cout.width(10);
+            cout << checkout_cost("sqlite3:db=:memory:", threads[i]) << "  ";
+            cout.width(10);
+            cout << checkout_cost(sharded, threads[i]) << endl;
+        }
+
+        cout << "heap allocations per borrow" << endl;
+        cout << "  mutex:   " << borrow_allocations("sqlite3:db=:memory:") << endl;
+        cout << "  sharded: " << borrow_allocations(sharded) << endl;
+    }
+    catch(std::exception& e)
+    {
+        cout << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -17,7 +17,7 @@ const size_t THREAD_POOL_SIZE = 8;
 
 boost::atomic<size_t> total_initialized_sessions(size_t(0));
 
-void init_session(session& sess)
+void init_session(session sess)
 {
     sess.once() <<
         "~Microsoft SQL Server~create table #test(txt varchar(20))"
@@ -105,6 +105,464 @@ BOOST_AUTO_TEST_CASE(SessionPoolExceptionFromSessionInit)
       );
 }
 
+void slow_init(session)
+{
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(200));
+}
+
+void open_session(session_pool& pool)
+{
+    session sess = pool.open();
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(50));
+}
+
+BOOST_AUTO_TEST_CASE(SessionPoolParallelConnect)
+{
+    session_pool pool("sqlite3:db=:memory:", DB_POOL_SIZE);
+    pool.invoke_on_connect(&slow_init);
+
+    boost::chrono::steady_clock::time_point start = boost::chrono::steady_clock::now();
+
+    boost::thread_group tg;
+    for (size_t i = 0; i < DB_POOL_SIZE; ++i)
+        tg.create_thread(boost::bind(open_session, boost::ref(pool)));
+
+    // Pool lock is not held while connections are initialized
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(50));
+    BOOST_CHECK_EQUAL(pool.stat().open, int(DB_POOL_SIZE));
+
+    tg.join_all();
+
+    // Connections are created in parallel, serial creation takes 800 ms
+    BOOST_CHECK_LT(boost::chrono::duration<double>(boost::chrono::steady_clock::now() - start).count(), 0.6);
+    BOOST_CHECK_EQUAL(pool.stat().idle, int(DB_POOL_SIZE));
+}
+
+BOOST_AUTO_TEST_CASE(SessionPoolFailedConnect)
+{
+    session_pool pool("sqlite3:db=:memory:", 1);
+    pool.invoke_on_connect(&throw_something);
+
+    BOOST_CHECK_THROW(pool.open(), std::logic_error);
+
+    session sess;
+    BOOST_CHECK_THROW(pool.try_open(sess), std::logic_error);
+
+    // Place reserved for failed connection is given back
+    pool.invoke_on_connect(session_pool::conn_init_callback());
+    BOOST_CHECK_EQUAL(pool.stat().open, 0);
+    BOOST_CHECK(pool.try_open(sess));
+    BOOST_CHECK_EQUAL(pool.stat().open, 1);
+}
+
+BOOST_AUTO_TEST_CASE(SessionPoolCacheStat)
+{
+    session_pool pool("sqlite3:db=:memory:", DB_POOL_SIZE);
+
+    {
+        session s1 = pool.open();
+        session s2 = pool.open();
+
+        s1 << "select 1";
+        s1 << "select 1";
+        s2 << "select 1";
+    }
+
+    statement_cache_stat st = pool.cache_stat();
+    BOOST_CHECK_EQUAL(st.hits, 1u);
+    BOOST_CHECK_EQUAL(st.misses, 2u);
+    BOOST_CHECK_EQUAL(st.entries, 2);
+}
+
+BOOST_AUTO_TEST_CASE(SessionPoolPrepareOnConnect)
+{
+    session_pool pool("sqlite3:db=:memory:", DB_POOL_SIZE);
+
+    std::vector<std::string> queries;
+    queries.push_back("select 1");
+    queries.push_back("select 2");
+    pool.prepare_on_connect(queries);
+
+    session sess = pool.open();
+    BOOST_CHECK_EQUAL(sess.cache_stat().entries, 2);
+
+    // Warm-up is accounted in pool statistics as soon as connection joins pool
+    BOOST_CHECK_EQUAL(pool.stat().cache.entries, 2);
+    BOOST_CHECK_EQUAL(pool.stat().cache.misses, 2u);
+
+    sess << "select 1";
+    BOOST_CHECK_EQUAL(sess.cache_stat().hits, 1u);
+    sess = session();
+
+    session_pool_stat st = pool.stat();
+    BOOST_CHECK_EQUAL(st.cache.entries, 2);
+    BOOST_CHECK_EQUAL(st.cache.misses, 2u);
+    BOOST_CHECK_EQUAL(st.cache.hits, 1u);
+}
+
+void borrow_loop(session_pool& pool, boost::atomic<size_t>& borrowed)
+{
+    for (int i = 0; i < 1000; ++i)
+    {
+        session sess = pool.open();
+        sess << "select 1" << first_row;
+        ++borrowed;
+
+        session other;
+        if (pool.try_open(other))
+            ++borrowed;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(SessionPoolSharded)
+{
+    session_pool pool("sqlite3:db=:memory:;@pool_shards=3", 2);
+    boost::atomic<size_t> borrowed(size_t(0));
+
+    boost::thread_group tg;
+    for (size_t i = 0; i < THREAD_POOL_SIZE; ++i)
+        tg.create_thread(boost::bind(borrow_loop, boost::ref(pool), boost::ref(borrowed)));
+    tg.join_all();
+
+    session_pool_stat st = pool.stat();
+    BOOST_CHECK_EQUAL(st.open, 2);
+    BOOST_CHECK_EQUAL(st.idle, 2);
+    BOOST_CHECK_EQUAL(st.borrows, borrowed.load());
+    BOOST_CHECK_EQUAL(st.cache.misses, 2u);
+    BOOST_CHECK_GT(st.execution_time, 0.0);
+
+    BOOST_CHECK_THROW(session_pool("sqlite3:db=:memory:;@pool_shards=-1", 2), edba_error);
+}
+
+// Wait until pool has expected number of idle connections
+bool wait_idle(session_pool& pool, int idle)
+{
+    for (int i = 0; i < 200 && pool.stat().idle != idle; ++i)
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+
+    return pool.stat().idle == idle;
+}
+
+void count_session(session)
+{
+    total_initialized_sessions++;
+}
+
+BOOST_AUTO_TEST_CASE(SessionPoolMinIdle)
+{
+    session_pool pool("sqlite3:db=:memory:;@pool_min_idle=2;@pool_prefill=on", DB_POOL_SIZE);
+    BOOST_CHECK(wait_idle(pool, 2));
+
+    // Maintainer replaces borrowed connections
+    session s1 = pool.open();
+    BOOST_CHECK(wait_idle(pool, 2));
+    BOOST_CHECK_EQUAL(pool.stat().open, 3);
+
+    total_initialized_sessions = 0;
+    session_pool lazy("sqlite3:db=:memory:;@pool_min_idle=3", DB_POOL_SIZE);
+    lazy.invoke_on_connect(&count_session);
+    BOOST_CHECK_EQUAL(lazy.stat().open, 0);
+
+    lazy.prefill();
+    BOOST_CHECK_EQUAL(lazy.stat().open, 3);
+    BOOST_CHECK_EQUAL(lazy.stat().idle, 3);
+    BOOST_CHECK_EQUAL(total_initialized_sessions, 3u);
+
+    // Connections opened by constructor are initialized by callback and warm-up passed to it
+    total_initialized_sessions = 0;
+    vector<string> queries(1, "select 1");
+    session_pool prefilled("sqlite3:db=:memory:;@pool_min_idle=2;@pool_prefill=on", DB_POOL_SIZE, 0, &count_session, queries);
+    BOOST_CHECK(wait_idle(prefilled, 2));
+    BOOST_CHECK_EQUAL(total_initialized_sessions, 2u);
+    BOOST_CHECK_EQUAL(prefilled.stat().cache.entries, 2);
+
+    BOOST_CHECK_THROW(session_pool("sqlite3:db=:memory:;@pool_prefill=yes", 2), edba_error);
+    BOOST_CHECK_THROW(session_pool("sqlite3:db=:memory:;@pool_idle_timeout=x", 2), edba_error);
+}
+
+void check_idle_timeout(const char* conn_str)
+{
+    session_pool pool(conn_str, DB_POOL_SIZE);
+
+    {
+        session s1 = pool.open();
+        session s2 = pool.open();
+        session s3 = pool.open();
+    }
+
+    // Maintainer may have opened one more connection for min idle
+    BOOST_CHECK_GE(pool.stat().idle, 3);
+
+    // Connections above min idle are closed after timeout
+    BOOST_CHECK(wait_idle(pool, 1));
+    BOOST_CHECK_EQUAL(pool.stat().open, 1);
+    BOOST_CHECK_GE(pool.stat().closed, 2u);
+
+    session sess = pool.open();
+    int one = 0;
+    sess.once() << "select 1" << first_row >> one;
+    BOOST_CHECK_EQUAL(one, 1);
+}
+
+BOOST_AUTO_TEST_CASE(SessionPoolIdleTimeout)
+{
+    check_idle_timeout("sqlite3:db=:memory:;@pool_idle_timeout=0.2;@pool_min_idle=1");
+    check_idle_timeout("sqlite3:db=:memory:;@pool_idle_timeout=0.2;@pool_min_idle=1;@pool_shards=2");
+}
+
+BOOST_AUTO_TEST_CASE(SessionPoolValidate)
+{
+    session_pool pool("sqlite3:db=:memory:;@pool_validate=on;@pool_validate_idle=0.05", 1);
+
+    {
+        session sess = pool.open();
+        BOOST_CHECK(sess.ping());
+        sess.once() << "create table t(id integer)" << exec;
+    }
+
+    // sqlite3 connection is never broken, so the same connection is given after validation
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(100));
+    session sess = pool.open();
+    sess.once() << "insert into t(id) values(1)" << exec;
+
+    session_pool_stat st = pool.stat();
+    BOOST_CHECK_EQUAL(st.open, 1);
+    BOOST_CHECK_EQUAL(st.borrows, 2u);
+    BOOST_CHECK_EQUAL(st.broken, 0u);
+
+    BOOST_CHECK(!session().ping());
+    BOOST_CHECK_THROW(session_pool("sqlite3:db=:memory:;@pool_validate=1", 1), edba_error);
+}
+
+void check_affinity(const char* conn_str, std::size_t key)
+{
+    session_pool pool(conn_str, 2);
+
+    {
+        session s1 = pool.open_with_affinity(1);
+        session s2 = pool.open_with_affinity(2);
+        s1 << "select 1" << first_row;
+        s2 << "select 2" << first_row;
+    }
+
+    // Connection that prepared statement of key is preferred to the one that would be taken without key
+    session sess = pool.open_with_affinity(key);
+    unsigned long long misses = sess.cache_stat().misses;
+    sess << (1 == key ? "select 1" : "select 2") << first_row;
+    BOOST_CHECK_EQUAL(sess.cache_stat().misses, misses);
+
+    session_pool_stat st = pool.stat();
+    BOOST_CHECK_EQUAL(st.affinity_hits, 1u);
+    BOOST_CHECK_EQUAL(st.affinity_misses, 2u);
+
+    // Open calls without key don`t count
+    session other = pool.open();
+    BOOST_CHECK_EQUAL(pool.stat().affinity_misses, 2u);
+    BOOST_CHECK_EQUAL(pool.busy(), 2);
+
+    other = session();
+    BOOST_CHECK_EQUAL(pool.busy(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(SessionPoolAffinity)
+{
+    // The last returned connection is taken from list, the first one stays in slot of thread
+    check_affinity("sqlite3:db=:memory:", 1);
+    check_affinity("sqlite3:db=:memory:;@pool_shards=1", 2);
+}
+
+// Idle connections are retired by lifetime, limit of each is reduced by jitter
+void check_lifetime(const char* conn_str)
+{
+    session_pool aging(conn_str, 2);
+    {
+        session s1 = aging.open();
+        session s2 = aging.open();
+    }
+
+    for (int i = 0; i < 200 && aging.stat().recycled < 2; ++i)
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+
+    BOOST_CHECK_GE(aging.stat().recycled, 2u);
+    BOOST_CHECK(wait_idle(aging, 2));
+    BOOST_CHECK_EQUAL(aging.stat().open, 2);
+}
+
+BOOST_AUTO_TEST_CASE(SessionPoolRecycle)
+{
+    session_pool pool("sqlite3:db=:memory:;@pool_max_uses=3;@pool_recycle_jitter=0", 1);
+
+    for (int i = 0; i < 3; ++i)
+    {
+        session sess = pool.open();
+        if (0 == i)
+            sess << "create table recycle_test(id integer)" << exec;
+        else
+            sess << "select count(*) from recycle_test" << first_row;
+    }
+
+    // Connection is replaced in background after third use, new in-memory database has no table
+    BOOST_CHECK(wait_idle(pool, 1));
+    BOOST_CHECK_EQUAL(pool.stat().recycled, 1u);
+    BOOST_CHECK_EQUAL(pool.stat().open, 1);
+
+    session sess = pool.open();
+    BOOST_CHECK_EQUAL(pool.stat().waits, 0u);
+    BOOST_CHECK_THROW(sess << "select count(*) from recycle_test" << first_row, edba_error);
+    sess = session();
+
+    check_lifetime("sqlite3:db=:memory:;@pool_max_lifetime=0.2;@pool_recycle_jitter=0.5");
+    check_lifetime("sqlite3:db=:memory:;@pool_max_lifetime=0.2;@pool_recycle_jitter=0.5;@pool_shards=2");
+
+    BOOST_CHECK_THROW(session_pool("sqlite3:db=:memory:;@pool_max_uses=-1", 2), edba_error);
+}
+
+void open_in_turn(session_pool& pool, int turn, boost::mutex& guard, vector<int>& order)
+{
+    session sess = pool.open(boost::chrono::seconds(10));
+    {
+        boost::mutex::scoped_lock g(guard);
+        order.push_back(turn);
+    }
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+}
+
+BOOST_AUTO_TEST_CASE(SessionPoolDeadline)
+{
+    session_pool pool("sqlite3:db=:memory:", 1);
+
+    session sess = pool.open();
+    BOOST_CHECK_THROW(pool.open(boost::chrono::milliseconds(50)), pool_timeout);
+    BOOST_CHECK_THROW(pool.open(boost::chrono::steady_clock::now() + boost::chrono::milliseconds(10)), pool_timeout);
+
+    session_pool_stat st = pool.stat();
+    BOOST_CHECK_EQUAL(st.timeouts, 2u);
+    BOOST_CHECK_EQUAL(st.waits, 2u);
+    BOOST_CHECK_GE(st.wait_max, 0.04);
+    BOOST_CHECK_GE(st.wait_time, 0.05);
+
+    // Waiters are served in order of arrival, returned connection is given to the first of them
+    boost::mutex guard;
+    vector<int> order;
+    boost::thread_group tg;
+    for (int i = 0; i < 4; ++i)
+    {
+        tg.create_thread(boost::bind(open_in_turn, boost::ref(pool), i, boost::ref(guard), boost::ref(order)));
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(30));
+    }
+
+    sess = session();
+
+    session other;
+    BOOST_CHECK(!pool.try_open(other));
+
+    tg.join_all();
+
+    BOOST_REQUIRE_EQUAL(order.size(), 4u);
+    for (int i = 0; i < 4; ++i)
+        BOOST_CHECK_EQUAL(order[i], i);
+
+    BOOST_CHECK_EQUAL(pool.stat().timeouts, 2u);
+    BOOST_CHECK_EQUAL(pool.stat().idle, 1);
+}
+
+void open_class_in_turn(session_pool& pool, int priority_class, boost::mutex& guard, vector<int>& order)
+{
+    session sess = pool.open(priority_class, boost::chrono::seconds(10));
+    {
+        boost::mutex::scoped_lock g(guard);
+        order.push_back(priority_class);
+    }
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+}
+
+BOOST_AUTO_TEST_CASE(SessionPoolPriorityClasses)
+{
+    session_pool pool("sqlite3:db=:memory:", 3);
+
+    int interactive = pool.define_class("interactive", 10, 1);
+    int batch = pool.define_class("batch", 0, 0, 1);
+    BOOST_CHECK_THROW(pool.define_class("other", 5, 3), edba_error);
+    BOOST_CHECK_THROW(pool.open(42), edba_error);
+
+    // Batch class can`t take connection reserved for interactive one
+    session b1, b2, b3, i1;
+    BOOST_CHECK(pool.try_open(b1, batch));
+    BOOST_CHECK(pool.try_open(b2, batch));
+    BOOST_CHECK(!pool.try_open(b3, batch));
+    BOOST_CHECK(pool.try_open(i1, interactive));
+
+    boost::mutex guard;
+    vector<int> order;
+    boost::thread_group tg;
+    tg.create_thread(boost::bind(open_class_in_turn, boost::ref(pool), batch, boost::ref(guard), boost::ref(order)));
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(30));
+
+    // Only one batch call may wait
+    BOOST_CHECK_THROW(pool.open(batch, boost::chrono::milliseconds(10)), pool_overloaded);
+    BOOST_CHECK_EQUAL(pool.stat().rejected, 1u);
+
+    tg.create_thread(boost::bind(open_class_in_turn, boost::ref(pool), interactive, boost::ref(guard), boost::ref(order)));
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(30));
+
+    // Interactive call is served first though it came later
+    b1 = session();
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(30));
+    b2 = session();
+    tg.join_all();
+
+    BOOST_REQUIRE_EQUAL(order.size(), 2u);
+    BOOST_CHECK_EQUAL(order[0], interactive);
+    BOOST_CHECK_EQUAL(order[1], batch);
+
+    session_pool_stat st = pool.stat();
+    BOOST_CHECK_EQUAL(st.waits, 2u);
+    BOOST_CHECK_EQUAL(st.timeouts, 0u);
+}
+
+BOOST_AUTO_TEST_CASE(SessionPoolReservedBehindBlockedWaiter)
+{
+    session_pool pool("sqlite3:db=:memory:", 4);
+
+    int high = pool.define_class("high", 10, 0);
+    int low = pool.define_class("low", 0, 2);
+
+    session h1, h2, h3;
+    BOOST_CHECK(pool.try_open(h1, high));
+    BOOST_CHECK(pool.try_open(h2, high));
+    BOOST_CHECK(!pool.try_open(h3, high));
+
+    boost::mutex guard;
+    vector<int> order;
+    boost::thread_group tg;
+    tg.create_thread(boost::bind(open_class_in_turn, boost::ref(pool), high, boost::ref(guard), boost::ref(order)));
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(30));
+
+    // Waiter of higher class can`t take connections reserved for lower class, so it doesn`t block it from them
+    session l1, l2;
+    BOOST_CHECK(pool.try_open(l1, low));
+    BOOST_CHECK_NO_THROW(l2 = pool.open(low, boost::chrono::milliseconds(500)));
+
+    h1 = session();
+    tg.join_all();
+    BOOST_CHECK_EQUAL(order.size(), 1u);
+}
+
+BOOST_AUTO_TEST_CASE(SessionPoolClassesOfUsedPool)
+{
+    session_pool pool("sqlite3:db=:memory:", 2);
+
+    session sess = pool.open();
+    BOOST_CHECK_THROW(pool.define_class("vip", 10, 1), edba_error);
+    sess = session();
+
+    // Returned sessions don`t disturb counts of classes
+    int vip = pool.define_class("vip", 10, 1);
+    session v1, v2;
+    BOOST_CHECK(pool.try_open(v1, vip));
+    BOOST_CHECK(pool.try_open(v2, vip));
+}
+
 BOOST_AUTO_TEST_CASE(SessionPoolSqlite3)
 {
     run_pool_test("sqlite3:db=test.db");
@@ -0,0 +1,96 @@
+#include <edba/edba.hpp>
+#include <edba/session_monitor.hpp>
+#include <edba/backend/stat_clock.hpp>
+
+#include <boost/timer/timer.hpp>
+#include <boost/chrono/chrono.hpp>
+
+#include <iostream>
+
+using namespace std;
+using namespace edba;
+
+namespace {
+
+const int iterations = 1000000;
+const int executions = 200000;
+
+typedef boost::chrono::steady_clock bench_clock;
+
+double ns_per_op(bench_clock::time_point start, int ops)
+{
+    return boost::chrono::duration<double, boost::nano>(bench_clock::now() - start).count() / ops;
+}
+
+// Way of measurement used by statement_stat before stat_clock
+double cpu_timer_overhead()
+{
+    boost::timer::cpu_timer timer;
+    double sink = 0;
+
+    bench_clock::time_point start = bench_clock::now();
+    for (int i = 0; i < iterations; ++i)
+    {
+        timer.start();
+        sink += boost::chrono::duration<double>(boost::chrono::nanoseconds(timer.elapsed().wall)).count();
+    }
+    double res = ns_per_op(start, iterations);
+
+    return sink >= 0 ? res : 0;
+}
+
+double stat_clock_overhead()
+{
+    double sink = 0;
+
+    bench_clock::time_point start = bench_clock::now();
+    for (int i = 0; i < iterations; ++i)
+    {
+        backend::stat_clock::time_point t = backend::stat_clock::now();
+        sink += backend::stat_clock::seconds_since(t);
+    }
+    double res = ns_per_op(start, iterations);
+
+    return sink >= 0 ? res : 0;
+}
+
+double execution_cost(session_monitor* m)
+{
+    session sess("sqlite3:db=:memory:", m);
+    statement st = sess << "select 1";
+
+    bench_clock::time_point start = bench_clock::now();
+    for (int i = 0; i < executions; ++i)
+        st.first_row();
+
+    return ns_per_op(start, executions);
+}
+
+}
+
+int main()
+{
+    try
+    {
+        session_monitor m;
+
+        cout << "clock pair overhead, ns per measurement" << endl;
+        cout << "  boost::timer::cpu_timer: " << cpu_timer_overhead() << endl;
+#if defined(EDBA_STAT_CLOCK_TSC)
+        cout << "  stat_clock (tsc):        " << stat_clock_overhead() << endl;
+#else
+        cout << "  stat_clock (steady):     " << stat_clock_overhead() << endl;
+#endif
+
+        cout << "sqlite3 'select 1' first_row, ns per execution" << endl;
+        cout << "  without monitor:         " << execution_cost(0) << endl;
+        cout << "  with monitor:            " << execution_cost(&m) << endl;
+    }
+    catch(std::exception& e)
+    {
+        cout << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,133 @@
+#include <edba/edba.hpp>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace edba;
+
+BOOST_AUTO_TEST_CASE(StatementCacheHit)
+{
+    session sess("sqlite3:db=:memory:");
+
+    statement st1 = sess << "select 1";
+    statement st2 = sess << "select 1";
+    statement st3 = sess << "select 2";
+
+    BOOST_CHECK(st1 == st2);
+    BOOST_CHECK(!(st1 == st3));
+}
+
+BOOST_AUTO_TEST_CASE(StatementCacheEviction)
+{
+    session sess("sqlite3:db=:memory:;@stmt_cache_size=2");
+
+    statement st1 = sess << "select 1";
+    statement st2 = sess << "select 2";
+
+    // Touch first statement, so second one becomes least recently used
+    BOOST_CHECK(st1 == (sess << "select 1"));
+
+    sess << "select 3";
+
+    BOOST_CHECK(st1 == (sess << "select 1"));
+    BOOST_CHECK(!(st2 == (sess << "select 2")));
+}
+
+BOOST_AUTO_TEST_CASE(StatementCacheDisabled)
+{
+    session sess("sqlite3:db=:memory:;@stmt_cache_size=0");
+
+    statement st1 = sess << "select 1";
+    BOOST_CHECK(!(st1 == (sess << "select 1")));
+
+    BOOST_CHECK_THROW(session("sqlite3:db=:memory:;@stmt_cache_size=-1"), edba_error);
+}
+
+BOOST_AUTO_TEST_CASE(StatementCacheStat)
+{
+    session sess("sqlite3:db=:memory:;@stmt_cache_size=2");
+
+    sess << "select 1";
+    sess << "select 1";
+    sess << "select 2";
+    sess << "select 3";
+
+    statement_cache_stat st = sess.cache_stat();
+    BOOST_CHECK_EQUAL(st.hits, 1u);
+    BOOST_CHECK_EQUAL(st.misses, 3u);
+    BOOST_CHECK_EQUAL(st.evictions, 1u);
+    BOOST_CHECK_EQUAL(st.entries, 2);
+    BOOST_CHECK_GE(st.prepare_time, 0.0);
+}
+
+BOOST_AUTO_TEST_CASE(StatementCacheConditionals)
+{
+    session sess("sqlite3:db=:memory:");
+
+    const char* q = "~Microsoft SQL Server~select 1~Sqlite3~select 2~~select 3";
+
+    for (int i = 0; i < 3; ++i)
+        BOOST_CHECK_EQUAL((sess << q).first_row().get<int>(0), 2);
+
+    BOOST_CHECK_EQUAL(sess.cache_stat().hits, 2u);
+    BOOST_CHECK((sess << "~Microsoft SQL Server~select 1~") == statement());
+}
+
+BOOST_AUTO_TEST_CASE(StatementCacheSqlLiteral)
+{
+    using namespace edba::literals;
+
+    BOOST_CONSTEXPR_OR_CONST sql_literal q = "  select :a + :b + :a  "_sql;
+
+#ifndef BOOST_NO_CXX14_CONSTEXPR
+    static_assert(q.bindings_count() == 3, "placeholders are counted at compile time");
+    static_assert(q.hash() == detail::hash_bytes("select :a + :b + :a", "select :a + :b + :a" + 19), "hash of trimmed text");
+
+    constexpr sql_placeholder a = q.placeholder("a");
+    static_assert(a.columns() == 5, "placeholder is resolved at compile time");
+#endif
+
+    BOOST_CHECK_EQUAL(q.hash(), string_ref_hash()(string_ref("select :a + :b + :a")));
+
+    session sess("sqlite3:db=:memory:");
+
+    statement st1 = sess << q;
+    statement st2 = sess << "select :a + :b + :a";
+
+    BOOST_CHECK(st1 == st2);
+    BOOST_CHECK_EQUAL((st1 << use("a", 1) << use("b", 2)).first_row().get<int>(0), 4);
+
+    st1.reset_bindings();
+    BOOST_CHECK_EQUAL(q.placeholder("b").columns(), 2u);
+    BOOST_CHECK_EQUAL(q.placeholder("ab").columns(), 0u);
+    BOOST_CHECK_EQUAL(st1.bind(q.placeholder("a"), 3).bind(q.placeholder("b"), 4).first_row().get<int>(0), 10);
+    BOOST_CHECK_THROW(st1.bind(q.placeholder("c"), 1), invalid_column);
+
+    BOOST_CHECK((sess << "~Microsoft SQL Server~select 1~Sqlite3~select 2~"_sql).first_row().get<int>(0) == 2);
+}
+
+BOOST_AUTO_TEST_CASE(StatementCacheMemoryLimit)
+{
+    session sess("sqlite3:db=:memory:;@stmt_cache_memory=1");
+
+    sess << "select 1";
+    BOOST_CHECK_GT(sess.cache_stat().memory, 0);
+
+    // Only the most recently added statement is kept when memory limit is exceeded
+    sess << "select 2";
+    BOOST_CHECK_EQUAL(sess.cache_stat().entries, 1);
+    BOOST_CHECK_EQUAL(sess.cache_stat().evictions, 1u);
+
+    session unlimited("sqlite3:db=:memory:");
+    unlimited << "select 1";
+    unlimited << "select 2";
+    BOOST_CHECK_EQUAL(unlimited.cache_stat().entries, 2);
+    BOOST_CHECK_GT(unlimited.cache_stat().memory, sess.cache_stat().memory);
+
+    // Memory is measured again when statement is taken from cache, so buffers of bound values are accounted
+    long long before = unlimited.cache_stat().memory;
+    unlimited << "select :a" << std::string(100000, 'x') << first_row;
+    long long bound = unlimited.cache_stat().memory;
+    unlimited << "select :a";
+    BOOST_CHECK_GT(unlimited.cache_stat().memory, bound);
+    BOOST_CHECK_GT(bound, before);
+}
@@ -0,0 +1,134 @@
+#include <edba/edba.hpp>
+#include <edba/trace_recorder.hpp>
+
+#include <boost/test/unit_test.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <sstream>
+
+using namespace std;
+using namespace edba;
+
+namespace {
+
+size_t count_of(const string& s, const string& what)
+{
+    size_t res = 0;
+    for (size_t pos = s.find(what); pos != string::npos; pos = s.find(what, pos + what.size()))
+        ++res;
+    return res;
+}
+
+struct opened_connections : session_monitor
+{
+    virtual void session_opened(std::size_t connection, double)
+    {
+        ids.push_back(connection);
+    }
+
+    vector<std::size_t> ids;
+};
+
+}
+
+BOOST_AUTO_TEST_CASE(TraceRecorderSessionPool)
+{
+    trace_recorder recorder;
+    session_pool pool("sqlite3:db=:memory:", 1, &recorder);
+
+    {
+        session sess = pool.open();
+        sess.once() << "create table t(id integer primary key, txt text)" << exec;
+
+        transaction tr(sess);
+        sess.once() << "insert into t(id, txt) values(1, 'a \"quoted\" \\\\ text')" << exec;
+        tr.commit();
+
+        rowset<> rs = sess << "select id from t";
+        for (rowset<>::iterator i = rs.begin(); i != rs.end(); ++i)
+            ;
+    }
+
+    ostringstream os;
+    recorder.write(os);
+    string trace = os.str();
+
+    BOOST_CHECK_EQUAL(trace.find("{\"traceEvents\":["), 0u);
+    BOOST_CHECK(trace.find("\"displayTimeUnit\":\"ms\"}") != string::npos);
+
+    BOOST_CHECK(trace.find("\"name\":\"create table t(id integer primary key, txt text)\",\"cat\":\"statement\",\"ph\":\"X\"") != string::npos);
+    BOOST_CHECK(trace.find("\"name\":\"insert into t(id, txt) values(1, 'a \\\"quoted\\\" \\\\\\\\ text')\"") != string::npos);
+    BOOST_CHECK(trace.find("\"name\":\"select id from t\",\"cat\":\"query\",\"ph\":\"X\"") != string::npos);
+    BOOST_CHECK(trace.find("\"rows\":1") != string::npos);
+
+    BOOST_CHECK_EQUAL(count_of(trace, "\"name\":\"transaction\",\"cat\":\"transaction\",\"ph\":\"b\""), 1u);
+    BOOST_CHECK_EQUAL(count_of(trace, "\"name\":\"transaction\",\"cat\":\"transaction\",\"ph\":\"e\""), 1u);
+    BOOST_CHECK_EQUAL(count_of(trace, "\"name\":\"session\",\"cat\":\"pool\",\"ph\":\"b\""), 1u);
+    BOOST_CHECK_EQUAL(count_of(trace, "\"name\":\"session\",\"cat\":\"pool\",\"ph\":\"e\""), 1u);
+
+    // Events inside session carry identifier of pooled connection
+    BOOST_CHECK_EQUAL(count_of(trace, "\"connection\":0,"), 0u);
+    BOOST_CHECK_EQUAL(recorder.dropped(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(TraceRecorderLimit)
+{
+    trace_recorder recorder(0, 3);
+    session sess("sqlite3:db=:memory:", &recorder);
+
+    for (int i = 0; i < 5; ++i)
+        sess.once() << "select " + boost::lexical_cast<string>(i) << first_row;
+
+    ostringstream os;
+    recorder.write(os);
+
+    BOOST_CHECK_EQUAL(count_of(os.str(), "\"cat\":\"query\""), 3u);
+    BOOST_CHECK_EQUAL(count_of(os.str(), "\"connection\":0,"), 0u);
+    BOOST_CHECK_EQUAL(recorder.dropped(), 2u);
+
+    BOOST_CHECK_THROW(recorder.save("/nonexistent/dir/trace.json"), edba_error);
+}
+
+BOOST_AUTO_TEST_CASE(TraceRecorderTwoSessionsOfThread)
+{
+    opened_connections opened;
+    trace_recorder recorder(&opened);
+    session_pool pool("sqlite3:db=:memory:", 2, &recorder);
+
+    session first = pool.open();
+    session second = pool.open();
+    first.once() << "select 1" << first_row;
+    second.once() << "select 2" << first_row;
+    {
+        transaction tr(second);
+        first.once() << "select 3" << first_row;
+        tr.commit();
+    }
+
+    // Sessions are returned in other order than they were taken
+    first = session();
+    second.once() << "select 4" << first_row;
+    second = session();
+
+    BOOST_REQUIRE_EQUAL(opened.ids.size(), 2u);
+    BOOST_CHECK(opened.ids[0] != opened.ids[1]);
+
+    ostringstream os;
+    recorder.write(os);
+    string trace = os.str();
+
+    // Queries are attributed to connection that executed them regardless of other sessions of thread
+    string first_args = "\"args\":{\"connection\":" + boost::lexical_cast<string>(opened.ids[0]) + ",\"ok\":true,\"rows\"";
+    string second_args = "\"args\":{\"connection\":" + boost::lexical_cast<string>(opened.ids[1]) + ",\"ok\":true,\"rows\"";
+    BOOST_CHECK_EQUAL(count_of(trace, first_args), 2u);
+    BOOST_CHECK_EQUAL(count_of(trace, second_args), 2u);
+
+    // Sessions and transactions are async events identified by connection, so they don`t have to nest
+    ostringstream first_id, second_id;
+    first_id << "\"id\":\"0x" << hex << opened.ids[0] << '"';
+    second_id << "\"id\":\"0x" << hex << opened.ids[1] << '"';
+    BOOST_CHECK_EQUAL(count_of(trace, first_id.str()), 2u);
+    BOOST_CHECK_EQUAL(count_of(trace, second_id.str()), 4u);
+    BOOST_CHECK_EQUAL(count_of(trace, "\"ph\":\"B\""), 0u);
+    BOOST_CHECK_EQUAL(count_of(trace, "\"ph\":\"E\""), 0u);
+}